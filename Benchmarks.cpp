@@ -0,0 +1,765 @@
+#include "pch.h"
+
+#include "Benchmarks.h"
+#include "Converters.h"
+#include "PathProjectionNN.h"
+#include "RecurrentModel.h"
+#include "SequenceLogger.h"
+#include "TrajectoryIndex.h"
+#include "Resampler.h"
+
+#include <iostream>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace chrono;
+
+static filesystem::path results_filename = "benchmark_results.json";
+
+static constexpr int window_input = 12;
+static constexpr int window_length = window_input + 1;
+static constexpr int window_features = (window_input - 2) * 2;
+static constexpr int converter_windows_n = 200000;
+
+static constexpr int training_epochs = 20;
+static constexpr double target_loss = 0.05;
+static constexpr int training_sequence_length = 60;
+static constexpr int training_batch_sizes[] = {100, 400, 1600};
+static constexpr int training_dataset_sizes[] = {2000, 10000, 40000};
+
+static constexpr int models_dataset_size = 10000;
+static constexpr int models_held_out_n = 256;
+static constexpr int model_horizons[] = {1, 5, 10};
+static constexpr int streaming_players[] = {1, 256};
+static constexpr int streaming_points = 10;
+
+static constexpr milliseconds resampling_horizon = 80ms;
+static constexpr int resampling_events_n = 200000;
+
+static vector<vector<vec2>> make_synthetic_sequences( int sequences_n, int length, unsigned seed = 1 )
+{
+	mt19937 rng(seed);
+	uniform_real_distribution<double> start(0, 1000), heading0(0, 2 * numbers::pi);
+	normal_distribution<double> turn(0, 0.15), accel(0, 0.6);
+
+	vector<vector<vec2>> sequences(sequences_n);
+	for (vector<vec2>& seq : sequences)
+	{
+		vec2 p = {start(rng), start(rng)};
+		double heading = heading0(rng), speed = 8;
+
+		seq.reserve(length);
+		for (int i = 0; i < length; ++i)
+		{
+			heading += turn(rng);
+			speed = clamp(speed + accel(rng), 1., 40.);
+			p += vec2{cos(heading), sin(heading)} * speed;
+			seq.push_back(p);
+		}
+	}
+
+	return sequences;
+}
+
+static double elapsed_ms( auto&& f )
+{
+	auto start = steady_clock::now();
+	f();
+	return duration<double, milli>(steady_clock::now() - start).count();
+}
+
+static PointsSoA make_windows( const vector<vector<vec2>>& sequences )
+{
+	PointsSoA windows(sequences.size(), window_length);
+	for (int lane = 0; lane < sequences.size(); ++lane)
+	for (int t = 0; t < window_length; ++t)
+		windows.set(t, lane, sequences[lane][t]);
+	return windows;
+}
+
+static bool validate_batch_converters()
+{
+	using Scalar = TConverter<Mode::AnglesLengths>;
+	using Batch = BatchConverter<Mode::AnglesLengths>;
+
+	vector<vector<vec2>> sequences = make_synthetic_sequences(converter_windows_n / 10, window_length, 2);
+	PointsSoA windows = make_windows(sequences);
+
+	mat scalar_in(window_features, windows.lanes_n), scalar_out(2, windows.lanes_n);
+	mat batch_in(window_features, windows.lanes_n), batch_out(2, windows.lanes_n);
+
+	vector<vec2> scalar_decoded;
+	for (int lane = 0; lane < windows.lanes_n; ++lane)
+	{
+		Scalar pipe([&, t = 0]() mutable { return windows.get(t++, lane); });
+		pipe.in(scalar_in.col(lane));
+		pipe.in(scalar_out.col(lane));
+
+		Scalar decoder([&, t = window_input - 2]() mutable { return windows.get(t++, lane); });
+		decoder.out(vec(scalar_out.col(lane)), back_insert_iterator(scalar_decoded));
+	}
+
+	Batch encoder(windows, 0);
+	encoder.in(batch_in);
+	encoder.in(batch_out);
+
+	PointsSoA decoded = windows;
+	Batch decoder(decoded, window_input - 2);
+	decoder.out(batch_out);
+
+	double angle_error = 0, length_error = 0, decode_error = 0;
+	for (int lane = 0; lane < windows.lanes_n; ++lane)
+	{
+		for (int i = 0; i < batch_in.n_rows; i += 2)
+		{
+			angle_error = max(angle_error, abs(batch_in(i, lane) - scalar_in(i, lane)) / angle_scale);
+			length_error = max(length_error, abs(batch_in(i + 1, lane) - scalar_in(i + 1, lane)) / coords_scale);
+		}
+
+		decode_error = max(decode_error, length(decoded.get(window_input, lane) - scalar_decoded[lane]));
+	}
+
+	// the primitives the decoder rotates and normalizes with, on the angles and segments of the same windows
+	double sincos_error = 0, rsqrt_error = 0;
+	for (int lane = 0; lane < windows.lanes_n; ++lane)
+	{
+		double a = batch_out(0, lane) / angle_scale, s, c;
+		fast::sincos(a, s, c);
+		sincos_error = max({sincos_error, abs(s - sin(a)), abs(c - cos(a))});
+
+		vec2 v = windows.get(window_input - 1, lane) - windows.get(window_input - 2, lane);
+		double l2 = dot(v, v);
+		rsqrt_error = max(rsqrt_error, abs(fast::rsqrt(l2) * sqrt(l2) - 1));
+	}
+
+	bool passed = angle_error <= fast::atan2_max_error && length_error <= 1e-9 && decode_error <= 1e-6 &&
+				  sincos_error <= fast::sincos_max_error && rsqrt_error <= fast::rsqrt_max_rel_error;
+
+	cout << format("batch converters vs scalar: angle error {:.3g} rad, length error {:.3g} px, decode error {:.3g} px, "
+				   "sincos error {:.3g}, rsqrt relative error {:.3g}: {}\n",
+				   angle_error, length_error, decode_error, sincos_error, rsqrt_error, passed ? "passed" : "FAILED");
+
+	return passed;
+}
+
+// compiles the header exported from a freshly initialized network on its own, with the compiler of this build,
+// and runs its reference_error(): the largest distance between the header's predict() and PathProjectionNN::Predict.
+// CXX overrides the compiler command; a header that does not compile or a compiler that cannot be run fails
+static bool validate_exported_header()
+{
+	filesystem::path directory = filesystem::temp_directory_path() /
+		format("header_validate_{}", steady_clock::now().time_since_epoch().count());
+	filesystem::create_directories(directory);
+
+	filesystem::path header = directory / "path_projection_model.h", source = directory / "reference_error.cpp";
+	filesystem::path executable = directory / "reference_error.exe", output = directory / "output.txt";
+
+	// a few optimizer steps only initialize the weights, the reference windows are then the header's arcs
+	PathProjectionNN nn;
+	PathProjectionNN::TrainingOptions options;
+	options.max_iterations = options.batch_size;
+	nn.SetTrainingOptions(options);
+
+	mat input, output_samples;
+	nn.BuildSamples(make_synthetic_sequences(50, training_sequence_length, 10), input, output_samples);
+	nn.Optimize(input, output_samples, {}, {});
+
+	bool exported;
+	{
+		ofstream header_file(header, ios::out | ios::trunc);
+		exported = nn.ExportHeader(header_file) && header_file.flush();
+	}
+
+	ofstream(source) << "#include \"path_projection_model.h\"\n#include <cstdio>\n"
+						"int main() { std::printf(\"%.17g\\n\", path_projection::reference_error()); }\n";
+
+	const char* cxx = getenv("CXX");
+#ifdef _MSC_VER
+	string compile = format(R"({} /nologo /std:c++20 /EHsc /O2 /Fe"{}" /Fo"{}\\" "{}")",
+							cxx ? cxx : "cl", executable.string(), directory.string(), source.string());
+#else
+	string compile = format(R"({} -std=c++20 -O2 -o "{}" "{}")", cxx ? cxx : "c++", executable.string(), source.string());
+#endif
+
+	bool compiled = exported && system(format(R"({} > "{}" 2>&1)", compile, (directory / "compile.txt").string()).c_str()) == 0;
+	bool ran = compiled && system(format(R"("{}" > "{}")", executable.string(), output.string()).c_str()) == 0;
+
+	double error = numeric_limits<double>::infinity();
+	if (ran) ifstream(output) >> error;
+
+	bool passed = error <= 1e-6;
+
+	cout << format("exported header vs PathProjectionNN::Predict: {}, max error {:.3g} px: {}\n",
+				   !exported ? "export failed" : !compiled ? format("compile failed ({}, log in {})", compile, directory.string()) :
+				   !ran ? "run failed" : "compiled standalone", error, passed ? "passed" : "FAILED");
+
+	// kept with the compiler log when it fails
+	error_code remove_error;
+	if (passed) filesystem::remove_all(directory, remove_error);
+
+	return passed;
+}
+
+// k nearest of the tree against a linear scan, for a batch built index and one grown by live insertion
+static bool validate_trajectory_index()
+{
+	constexpr int queries_n = 500;
+
+	vector<vector<vec2>> sequences = make_synthetic_sequences(400, training_sequence_length, 4);
+	vector<vector<vec2>> queries = make_synthetic_sequences(queries_n, TrajectoryIndex::window_points, 5);
+
+	TrajectoryIndex built, added;
+	built.Build(sequences);
+	for (const vector<vec2>& seq : sequences)
+		added.Add(seq);
+
+	int mismatches = 0;
+	for (const TrajectoryIndex* index : {&built, &added})
+	{
+		vector<pair<double, int>> scan(index->GetSize());
+		vec query(TrajectoryIndex::features_n);
+
+		for (const vector<vec2>& window : queries)
+		{
+			TConverter<Mode::AnglesLengths> pipe([it = window.begin()]() mutable { return *(it++); });
+			pipe.in(query.col(0));
+
+			for (int entry = 0; entry < scan.size(); ++entry)
+			{
+				const double* f = index->GetFeatures(entry);
+				double distance2 = 0;
+				for (int d = 0; d < TrajectoryIndex::features_n; ++d)
+					distance2 += (query[d] - f[d]) * (query[d] - f[d]);
+				scan[entry] = {distance2, entry};
+			}
+
+			vector<pair<double, int>> nearest = index->Nearest(query.memptr());
+			ranges::partial_sort(scan, scan.begin() + nearest.size());
+
+			// distances rather than entries, equally distant entries may come in any order
+			if (nearest.empty() || !ranges::equal(nearest, scan | views::take(nearest.size()), {}, &pair<double, int>::first, &pair<double, int>::first))
+				++mismatches;
+		}
+	}
+
+	bool passed = mismatches == 0;
+
+	cout << format("trajectory index vs linear scan: {} windows, {} queries on built and added trees, {} mismatches: {}\n",
+				   built.GetSize(), queries_n, mismatches, passed ? "passed" : "FAILED");
+
+	return passed;
+}
+
+// Log() to files and Read() back: points and timestamps must match exactly, across two loggers sharing a directory
+static bool validate_sequence_logger()
+{
+	filesystem::path directory = filesystem::temp_directory_path() /
+		format("mlsq_validate_{}", steady_clock::now().time_since_epoch().count());
+
+	vector<vector<vec2>> sequences = make_synthetic_sequences(40, training_sequence_length, 8);
+	vector<vector<system_clock::time_point>> times(sequences.size());
+
+	mt19937 rng(9);
+	uniform_int_distribution<int> interval_us(1, 40000);
+	system_clock::time_point t = system_clock::time_point(duration_cast<system_clock::duration>(microseconds(1'700'000'000'000'000)));
+
+	for (int i = 0; i < sequences.size(); ++i)
+	for (vec2& p : sequences[i])
+	{
+		// the log stores whole pixels and microseconds
+		p = {round(p[0]), round(p[1])};
+		times[i].push_back(t += duration_cast<system_clock::duration>(microseconds(interval_us(rng))));
+	}
+
+	bool logged = true;
+	for (int half = 0; half < 2; ++half)
+	{
+		SequenceLogger logger(SequenceLogger::Config{.directory = directory});
+		for (int i = half * sequences.size() / 2; i < (half + 1) * sequences.size() / 2; ++i)
+			logged &= logger.Log(sequences[i], times[i]);
+	}
+
+	vector<SequenceLogger::Sequence> read = SequenceLogger::Read(directory);
+
+	error_code error;
+	filesystem::remove_all(directory, error);
+
+	int mismatches = abs(int(read.size()) - int(sequences.size()));
+	for (int i = 0; i < min(read.size(), sequences.size()); ++i)
+	{
+		bool same = read[i].points.size() == sequences[i].size() && read[i].times == times[i];
+		for (int p = 0; same && p < sequences[i].size(); ++p)
+			same = equal(read[i].points[p], sequences[i][p]);
+		mismatches += !same;
+	}
+
+	bool passed = logged && mismatches == 0;
+
+	cout << format("sequence logger round trip: {} sequences written, {} read, {} mismatches: {}\n",
+				   sequences.size(), read.size(), mismatches, passed ? "passed" : "FAILED");
+
+	return passed;
+}
+
+static string benchmark_converters()
+{
+	using Scalar = TConverter<Mode::AnglesLengths>;
+	using Batch = BatchConverter<Mode::AnglesLengths>;
+
+	vector<vector<vec2>> sequences = make_synthetic_sequences(converter_windows_n, window_length, 3);
+	PointsSoA windows = make_windows(sequences);
+	PointsSoA decoded = windows;
+
+	mat input(window_features, windows.lanes_n), output(2, windows.lanes_n);
+	vector<vec2> scalar_decoded;
+	scalar_decoded.reserve(windows.lanes_n);
+
+	double scalar_encode_ms = elapsed_ms([&]
+	{
+		for (int lane = 0; lane < windows.lanes_n; ++lane)
+		{
+			Scalar pipe([&, t = 0]() mutable { return windows.get(t++, lane); });
+			pipe.in(input.col(lane));
+			pipe.in(output.col(lane));
+		}
+	});
+
+	double scalar_decode_ms = elapsed_ms([&]
+	{
+		for (int lane = 0; lane < windows.lanes_n; ++lane)
+		{
+			Scalar pipe([&, t = window_input - 2]() mutable { return windows.get(t++, lane); });
+			pipe.out(vec(output.col(lane)), back_insert_iterator(scalar_decoded));
+		}
+	});
+
+	double batch_encode_ms = elapsed_ms([&]
+	{
+		Batch pipe(windows, 0);
+		pipe.in(input);
+		pipe.in(output);
+	});
+
+	double batch_decode_ms = elapsed_ms([&]
+	{
+		Batch pipe(decoded, window_input - 2);
+		pipe.out(output);
+	});
+
+	double checksum = accu(input) + accu(output) + accu(vec(decoded.x)) + scalar_decoded.size();
+	double windows_k = windows.lanes_n / 1000.;
+
+	cout << format("encode: scalar {:.1f} ns/window, batch {:.1f} ns/window, x{:.1f}\n",
+				   scalar_encode_ms * 1e3 / windows_k, batch_encode_ms * 1e3 / windows_k, scalar_encode_ms / batch_encode_ms);
+	cout << format("decode: scalar {:.1f} ns/window, batch {:.1f} ns/window, x{:.1f} (checksum {:.3g})\n",
+				   scalar_decode_ms * 1e3 / windows_k, batch_decode_ms * 1e3 / windows_k, scalar_decode_ms / batch_decode_ms, checksum);
+
+	return format(R"({{"windows":{},"scalar_encode_ns":{:.1f},"batch_encode_ns":{:.1f},"scalar_decode_ns":{:.1f},"batch_decode_ns":{:.1f}}})",
+				  windows.lanes_n, scalar_encode_ms * 1e3 / windows_k, batch_encode_ms * 1e3 / windows_k,
+				  scalar_decode_ms * 1e3 / windows_k, batch_decode_ms * 1e3 / windows_k);
+}
+
+// peak resident set size from construction to mb(), so every training run reports its own peak rather than
+// the process high-water mark left by earlier benchmarks. Linux resets the kernel's mark (clear_refs, then
+// VmHWM); Windows cannot reset PeakWorkingSetSize, so the working set is sampled every sample_period. It is
+// neither trimmed first nor sampled often, so that page faults and the sampler do not skew the timed run.
+// Freed heap stays resident, so the peak never drops below the resident size at the start: start_mb.
+class PeakRssMeter
+{
+#ifdef _WIN32
+	atomic<bool> stopping = false;
+	atomic<size_t> peak_bytes = 0;
+	thread sampler;
+
+	static constexpr milliseconds sample_period = 50ms;
+
+	static size_t working_set()
+	{
+		PROCESS_MEMORY_COUNTERS counters = {};
+		GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+		return counters.WorkingSetSize;
+	}
+#else
+	// a "Vm...:  <n> kB" line of /proc/self/status, -1 without procfs
+	static double status_mb( string_view field )
+	{
+		ifstream status("/proc/self/status");
+		for (string line; getline(status, line);)
+			if (line.starts_with(field))
+				return stod(line.substr(field.size())) / 1024;
+		return -1;
+	}
+#endif
+
+public:
+	double start_mb = 0;
+
+	// false when the mark could not be reset and mb() is the process lifetime peak
+	bool per_run = true;
+
+	PeakRssMeter()
+	{
+#ifdef _WIN32
+		peak_bytes = working_set();
+		start_mb = peak_bytes / double(1 << 20);
+		sampler = thread([this]
+		{
+			for (; !stopping; this_thread::sleep_for(sample_period))
+				peak_bytes = max<size_t>(peak_bytes, working_set());
+		});
+#else
+		ofstream clear_refs("/proc/self/clear_refs");
+		clear_refs << "5";
+		clear_refs.flush();
+		per_run = bool(clear_refs);
+		start_mb = max(0., status_mb("VmRSS:"));
+#endif
+	}
+
+	~PeakRssMeter()
+	{
+#ifdef _WIN32
+		stopping = true;
+		sampler.join();
+#endif
+	}
+
+	double mb()
+	{
+#ifdef _WIN32
+		peak_bytes = max<size_t>(peak_bytes, working_set());
+		return peak_bytes / double(1 << 20);
+#else
+		double peak_mb = status_mb("VmHWM:");
+		if (peak_mb >= 0) return peak_mb;
+
+		per_run = false;
+		rusage usage = {};
+		getrusage(RUSAGE_SELF, &usage);
+		return usage.ru_maxrss / 1024.;
+#endif
+	}
+};
+
+// OpenMP threads used by mlpack and Armadillo; without OpenMP every run is single threaded
+static void set_threads( int threads_n )
+{
+#ifdef _OPENMP
+	omp_set_num_threads(threads_n);
+#endif
+}
+
+static string json_array( const vector<double>& values )
+{
+	string json = "[";
+	for (double v : values)
+		json += format("{}{:.4g}", json.size() > 1 ? "," : "", v);
+	return json + "]";
+}
+
+static string benchmark_training_run( const string& dataset, const vector<vector<vec2>>& sequences, int batch_size, int threads_n )
+{
+	set_threads(threads_n);
+
+	PeakRssMeter peak_rss;
+
+	PathProjectionNN nn;
+	mat input, output;
+
+	int samples_n = 0;
+	double samples_ms = elapsed_ms([&] { samples_n = nn.BuildSamples(sequences, input, output); });
+
+	PathProjectionNN::TrainingOptions options;
+	options.batch_size = batch_size;
+	options.max_iterations = size_t(samples_n) * training_epochs;
+	nn.SetTrainingOptions(options);
+
+	vector<double> samples_per_s, losses;
+	double time_to_target_s = -1;
+
+	auto start = steady_clock::now(), epoch_start = start;
+	auto epoch_callback = [&](int epoch, double loss)
+	{
+		auto now = steady_clock::now();
+		samples_per_s.push_back(samples_n / duration<double>(now - epoch_start).count());
+		losses.push_back(loss);
+		if (time_to_target_s < 0 && loss <= target_loss)
+			time_to_target_s = duration<double>(now - start).count();
+		epoch_start = now;
+	};
+
+	nn.Optimize(input, output, epoch_callback, {});
+	double optimization_s = duration<double>(steady_clock::now() - start).count();
+
+	double mean_samples_per_s = samples_per_s.empty() ? 0 : ranges::fold_left(samples_per_s, 0., plus()) / samples_per_s.size();
+	double peak_rss_mb = peak_rss.mb();
+
+	cout << format("{} samples {} batch {} threads {}: samples {:.1f} ms, {:.0f} samples/s, target loss {}, peak rss {:.0f} MB (+{:.0f} MB){}\n",
+				   dataset, samples_n, batch_size, threads_n, samples_ms, mean_samples_per_s,
+				   time_to_target_s < 0 ? string("not reached") : format("{:.2f} s", time_to_target_s), peak_rss_mb,
+				   peak_rss_mb - peak_rss.start_mb, peak_rss.per_run ? "" : " (process peak)");
+
+	return format(R"({{"dataset":"{}","samples":{},"batch_size":{},"threads":{},"samples_ms":{:.3f},"optimization_s":{:.3f},)"
+				  R"("mean_samples_per_s":{:.1f},"samples_per_s":{},"losses":{},"target_loss":{},"time_to_target_s":{},"peak_rss_mb":{:.1f},"rss_growth_mb":{:.1f},"peak_rss_per_run":{}}})",
+				  dataset, samples_n, batch_size, threads_n, samples_ms, optimization_s,
+				  mean_samples_per_s, json_array(samples_per_s), json_array(losses), target_loss,
+				  time_to_target_s < 0 ? string("null") : format("{:.3f}", time_to_target_s), peak_rss_mb,
+				  peak_rss_mb - peak_rss.start_mb, peak_rss.per_run);
+}
+
+static string benchmark_training( const filesystem::path& recorded_path )
+{
+	vector<int> threads = {1};
+	if (int hardware_threads = thread::hardware_concurrency(); hardware_threads > 1)
+		threads.push_back(hardware_threads);
+
+	vector<pair<string, vector<vector<vec2>>>> datasets;
+
+	// windows per sequence: every point after the first 13 starts one sample
+	int samples_per_sequence = training_sequence_length - window_length;
+	for (int samples_n : training_dataset_sizes)
+		datasets.emplace_back(format("synthetic_{}", samples_n),
+							  make_synthetic_sequences(samples_n / samples_per_sequence, training_sequence_length, samples_n));
+
+	if (!recorded_path.empty())
+	{
+		vector<vector<vec2>>& recorded = datasets.emplace_back(recorded_path.filename().string(), vector<vector<vec2>>()).second;
+		// logs hold the raw events, the models train on fixed-rate samples
+		for (SequenceLogger::Sequence& seq : SequenceLogger::Read(recorded_path))
+		for (vector<vec2>& samples : Resampler::Resample(seq.points, seq.times, Resampler::Config()))
+			if (samples.size() > window_length)
+				recorded.push_back(move(samples));
+	}
+
+	string json = "[";
+	for (auto& [dataset, sequences] : datasets)
+	for (int batch_size : training_batch_sizes)
+	for (int threads_n : threads)
+	{
+		if (sequences.empty()) continue;
+		json += (json.size() > 1 ? ",\n" : "\n") + benchmark_training_run(dataset, sequences, batch_size, threads_n);
+	}
+
+	return json + "\n]";
+}
+
+// mean distance to the real points at each of model_horizons, over non-overlapping windows of the sequences;
+// predict gets the first of window_input points and returns at least the longest horizon
+static vector<double> horizon_errors( const vector<vector<vec2>>& sequences, const function<vector<vec2>(const vec2*)>& predict )
+{
+	int horizon = ranges::max(model_horizons);
+
+	vector<double> errors(size(model_horizons));
+	int windows_n = 0;
+
+	for (const vector<vec2>& seq : sequences)
+	for (int i = 0; i + window_input + horizon <= int(seq.size()); i += window_input, ++windows_n)
+	{
+		vector<vec2> predicted = predict(&seq[i]);
+		for (int h = 0; h < size(model_horizons); ++h)
+			errors[h] += length(predicted[model_horizons[h] - 1] - seq[i + window_input + model_horizons[h] - 1]);
+	}
+
+	for (double& error : errors)
+		error /= max(windows_n, 1);
+
+	return errors;
+}
+
+// every player replays one held-out sequence, a point per event: Observe() then a streaming_points rollout
+static string benchmark_streaming( PathProjectionNN& nn, const vector<vector<vec2>>& sequences, int players_n )
+{
+	double observe_ms = 0, predict_ms = 0;
+	size_t predicted_n = 0, state_bytes = 0;
+	int length = sequences[0].size(), predict_events_n = 0;
+
+	for (int t = 0; t < length; ++t)
+	{
+		observe_ms += elapsed_ms([&]
+		{
+			for (int player = 0; player < players_n; ++player)
+				nn.Observe(player, sequences[player % sequences.size()][t]);
+		});
+
+		if (t + 1 < window_input) continue;
+
+		predict_ms += elapsed_ms([&]
+		{
+			for (int player = 0; player < players_n; ++player)
+				predicted_n += nn.PredictPlayer(player, streaming_points).size();
+		});
+		predict_events_n += players_n;
+	}
+
+	for (int player = 0; player < players_n; ++player)
+	{
+		state_bytes += nn.GetPlayerStateBytes(player);
+		nn.ResetPlayer(player);
+	}
+
+	double observe_ns = observe_ms * 1e6 / (length * players_n);
+	double predict_ns = predict_ms * 1e6 / predict_events_n;
+
+	cout << format("  {} players: observe {:.0f} ns/event, predict {} points {:.0f} ns/event, state {} bytes/player ({} points)\n",
+				   players_n, observe_ns, streaming_points, predict_ns, state_bytes / players_n, predicted_n);
+
+	return format(R"({{"players":{},"observe_ns":{:.1f},"predict_ns":{:.1f},"state_bytes_per_player":{}}})",
+				  players_n, observe_ns, predict_ns, state_bytes / players_n);
+}
+
+// the MLP against the recurrent model on the same data and epochs: accuracy per horizon,
+// per-event streaming latency and memory per player; then the retrieval index on the same data
+static string benchmark_models()
+{
+	using Model = PathProjectionNN::Model;
+
+	int samples_per_sequence = training_sequence_length - window_length;
+	int chunks_per_sequence = (training_sequence_length - RecurrentModel::chunk_points) / RecurrentModel::chunk_stride + 1;
+
+	vector<vector<vec2>> sequences = make_synthetic_sequences(models_dataset_size / samples_per_sequence, training_sequence_length, 4);
+	vector<vector<vec2>> held_out = make_synthetic_sequences(models_held_out_n, training_sequence_length, 5);
+
+	string json = "[";
+	for (auto [name, model] : {pair("feed_forward", Model::FeedForward), pair("recurrent", Model::Recurrent)})
+	{
+		PathProjectionNN nn(model);
+
+		// max_iterations counts windows for the MLP and chunks for the recurrent model
+		PathProjectionNN::TrainingOptions options;
+		options.max_iterations = sequences.size() * training_epochs * (model == Model::Recurrent ? chunks_per_sequence : samples_per_sequence);
+		nn.SetTrainingOptions(options);
+
+		double train_s = elapsed_ms([&] { nn.Train(sequences, {}, {}); }) / 1000;
+
+		vector<double> errors = horizon_errors(held_out, [&](const vec2* window)
+			{ return nn.Predict(ranges::max(model_horizons), [it = window]() mutable { return *(it++); }); });
+
+		cout << format("{}: training {:.1f} s, error at {} points ahead {} px\n",
+					   name, train_s, json_array({begin(model_horizons), end(model_horizons)}), json_array(errors));
+
+		string streaming = "[";
+		for (int players_n : streaming_players)
+			streaming += (streaming.size() > 1 ? "," : "") + benchmark_streaming(nn, held_out, players_n);
+
+		json += format(R"({}{{"model":"{}","train_s":{:.3f},"horizons":{},"horizon_errors":{},"streaming":{}]}})",
+					   json.size() > 1 ? ",\n" : "\n", name, train_s,
+					   json_array({begin(model_horizons), end(model_horizons)}), json_array(errors), streaming);
+	}
+
+	// the retrieval index on the same sequences: half built in bulk, half inserted one sequence at a time
+	{
+		TrajectoryIndex index;
+
+		auto half = sequences.begin() + sequences.size() / 2;
+		double build_s = elapsed_ms([&] { index.Build({sequences.begin(), half}); }) / 1000;
+
+		size_t built_n = index.GetSize();
+		double insert_ms = elapsed_ms([&] { for (auto it = half; it != sequences.end(); ++it) index.Add(*it); });
+		double insert_ns = insert_ms * 1e6 / max<size_t>(index.GetSize() - built_n, 1);
+
+		vector<double> errors = horizon_errors(held_out, [&](const vec2* window)
+			{ return index.Predict(ranges::max(model_horizons), [it = window]() mutable { return *(it++); }); });
+
+		int queries_n = 0;
+		size_t predicted_n = 0;
+		double query_ms = elapsed_ms([&]
+		{
+			for (const vector<vec2>& seq : held_out)
+			for (int i = 0; i + window_input <= int(seq.size()); ++i, ++queries_n)
+				predicted_n += index.Predict(streaming_points, [it = seq.begin() + i]() mutable { return *(it++); }).size();
+		});
+		double query_ns = query_ms * 1e6 / queries_n;
+
+		cout << format("nearest_neighbours: {} windows, build {:.2f} s, insert {:.0f} ns/window, error at {} points ahead {} px\n",
+					   index.GetSize(), build_s, insert_ns, json_array({begin(model_horizons), end(model_horizons)}), json_array(errors));
+		cout << format("  query {} points {:.0f} ns ({} points)\n", streaming_points, query_ns, predicted_n);
+
+		json += ",\n" + format(R"({{"model":"nearest_neighbours","windows":{},"build_s":{:.3f},"insert_ns":{:.1f},"horizons":{},"horizon_errors":{},"query_ns":{:.1f}}})",
+					   index.GetSize(), build_s, insert_ns,
+					   json_array({begin(model_horizons), end(model_horizons)}), json_array(errors), query_ns);
+	}
+
+	return json + "\n]";
+}
+
+// event intervals jittered between 1 and 16 ms: resampling cost per event, and the rollout steps a horizon takes
+// at the fixed rate against raw events, where covering it needs horizon / shortest interval steps
+static string benchmark_resampling()
+{
+	mt19937 rng(6);
+	uniform_int_distribution<int> interval_us(1000, 16000);
+
+	vector<vector<vec2>> sequences = make_synthetic_sequences(resampling_events_n / training_sequence_length, training_sequence_length, 7);
+
+	vector<vector<system_clock::time_point>> times(sequences.size());
+	microseconds shortest = microseconds::max(), total = 0us;
+	int events_n = 0;
+
+	for (vector<system_clock::time_point>& seq_times : times)
+	{
+		system_clock::time_point t = system_clock::time_point() + 1h;
+		for (int i = 0; i < training_sequence_length; ++i, ++events_n)
+		{
+			microseconds interval(interval_us(rng));
+			shortest = min(shortest, interval), total += interval;
+			seq_times.push_back(t += interval);
+		}
+	}
+
+	size_t samples_n = 0;
+	double resample_ms = elapsed_ms([&]
+	{
+		for (int i = 0; i < sequences.size(); ++i)
+		for (const vector<vec2>& samples : Resampler::Resample(sequences[i], times[i], Resampler::Config()))
+			samples_n += samples.size();
+	});
+
+	// up to one period passes between the last sample and the event the horizon is counted from
+	PathProjectionNN nn;
+	int fixed_steps = nn.GetHorizonPoints(resampling_horizon, Resampler::Config().period - 1us);
+	int raw_worst_steps = (resampling_horizon + shortest - 1us) / shortest;
+	double raw_mean_steps = duration<double>(resampling_horizon) / (duration<double>(total) / events_n);
+
+	cout << format("resampling: {:.1f} ns/event, {} events to {} samples; {} ms horizon: {} steps resampled, "
+				   "{} steps raw to cover the shortest interval, {:.1f} on average\n",
+				   resample_ms * 1e6 / events_n, events_n, samples_n, resampling_horizon.count(), fixed_steps, raw_worst_steps, raw_mean_steps);
+
+	return format(R"({{"events":{},"samples":{},"resample_ns":{:.1f},"horizon_ms":{},"fixed_steps":{},"raw_worst_steps":{},"raw_mean_steps":{:.2f}}})",
+				  events_n, samples_n, resample_ms * 1e6 / events_n, resampling_horizon.count(), fixed_steps, raw_worst_steps, raw_mean_steps);
+}
+
+// usage: [recorded sequences log file or directory]
+int benchmark_main( int argc, char* argv[] )
+{
+	if (!validate_batch_converters()) return 1;
+	if (!validate_exported_header()) return 1;
+	if (!validate_trajectory_index()) return 1;
+	if (!validate_sequence_logger()) return 1;
+
+	string converters = benchmark_converters();
+	string training = benchmark_training(argc > 1 ? argv[1] : "");
+	string models = benchmark_models();
+	string resampling = benchmark_resampling();
+
+	ofstream file(results_filename, ios::out | ios::trunc);
+	file << format("{{\n\"converters\":{},\n\"training\":{},\n\"models\":{},\n\"resampling\":{}\n}}\n",
+				   converters, training, models, resampling);
+
+	return 0;
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+// Headless benchmarks and validation runs, started from agg_main instead of the window when enabled.
+int benchmark_main( int argc, char* argv[] );
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <mlpack.hpp>
+
+#include "fast_math.h"
+#include "vec2_math.h"
+
+using namespace std;
+using namespace arma;
+
+enum class Mode { Points, Vectors, AnglesLengths };
+
+static constexpr Mode mode = Mode::AnglesLengths;
+
+static constexpr double coords_scale = 0.1;
+static constexpr double angle_scale = 10;
+
+template<Mode> struct TConverter;
+
+template<>
+struct TConverter<Mode::Points>
+{
+	vec2 p0;
+	function<vec2()> next;
+	TConverter(function<vec2()>&& next) : next(move(next)) { p0 = this->next(); }
+
+	void in(subview_col<double>&& col)
+	{
+		for (int i = 0; i < col.n_rows;)
+		{
+			vec2 v = p0 - next();
+			col[i++] = v[0], col[i++] = v[1];
+		}
+	}
+
+	void out(const vec& output, auto&& it)
+	{
+		for (int i = 0; i < output.n_rows; i += 2)
+			*it = p0 + vec2{output[i], output[i + 1]};
+	}
+};
+
+template<>
+struct TConverter<Mode::Vectors>
+{
+	vec2 p0;
+	function<vec2()> next;
+	TConverter(function<vec2()>&& next) : next(move(next)) { p0 = this->next(); }
+
+	void in(subview_col<double>&& col)
+	{
+		for (int i = 0; i < col.n_rows;)
+		{
+			vec2 p1 = next();
+			vec2 v = (p1 - p0) * coords_scale;
+			p0 = p1;
+			col[i++] = v[0], col[i++] = v[1];
+		}
+	}
+
+	void out(const vec& output, auto&& it)
+	{
+		for (int i = 0; i < output.n_rows; i += 2)
+			*it = (p0 += vec2{output[i], output[i + 1]} / coords_scale);
+	}
+};
+
+template<>
+struct TConverter<Mode::AnglesLengths>
+{
+	vec2 p0, p1;
+	function<vec2()> next;
+	TConverter(function<vec2()>&& next) : next(move(next)) { p0 = this->next(), p1 = this->next(); }
+
+	void in(subview_col<double>&& col)
+	{
+		for (int i = 0; i < col.n_rows;)
+		{
+			vec2 p2 = next();
+			vec2 v1 = p1 - p0;
+			vec2 v2 = p2 - p1;
+			p0 = p1, p1 = p2;
+
+			double l1, l2;
+			v1 = normalized(v1, l1);
+			v2 - normalized(v2, l2);
+
+			col[i++] = angle(v2, v1) * angle_scale;
+			col[i++] = l2 * coords_scale;
+		}
+	}
+
+	void out(const vec& output, auto&& it)
+	{
+		for (int i = 0; i < output.n_rows; i += 2)
+		{
+			double angle = output[i] / angle_scale;
+			vec2 v2 = rotate(normalized(p1 - p0), vec2{cos(angle), sin(angle)}) * (output [i + 1] / coords_scale);
+			p0 = p1;
+			p1 += v2;
+			*it = p1;
+		}
+	}
+};
+
+// Many point windows at once in SoA layout: row t holds the t-th point of every lane.
+struct PointsSoA
+{
+	int lanes_n = 0, rows_n = 0;
+	vector<double> x, y;
+
+	PointsSoA( int lanes_n, int rows_n ) : lanes_n(lanes_n), rows_n(rows_n), x(size_t(lanes_n) * rows_n), y(size_t(lanes_n) * rows_n) {}
+
+	double* X( int row ) { return x.data() + size_t(row) * lanes_n; }
+	double* Y( int row ) { return y.data() + size_t(row) * lanes_n; }
+	const double* X( int row ) const { return x.data() + size_t(row) * lanes_n; }
+	const double* Y( int row ) const { return y.data() + size_t(row) * lanes_n; }
+
+	void set( int row, int lane, const vec2& p ) { X(row)[lane] = p[0], Y(row)[lane] = p[1]; }
+	vec2 get( int row, int lane ) const { return {X(row)[lane], Y(row)[lane]}; }
+};
+
+// Batch counterpart of TConverter: every lane of a PointsSoA is one window and one column
+// of the feature matrices. Used the same way as TConverter: construct at the first row of the windows,
+// then in() consumes rows and out() appends decoded points after the last consumed row.
+template<Mode m>
+struct BatchConverter
+{
+	PointsSoA& pts;
+	int row;
+	vector<TConverter<m>> pipes;
+
+	struct LaneWriter
+	{
+		PointsSoA& pts;
+		int lane, row;
+		LaneWriter& operator*() { return *this; }
+		LaneWriter& operator=( const vec2& p ) { pts.set(row++, lane, p); return *this; }
+	};
+
+	BatchConverter(PointsSoA& pts, int row) : pts(pts), row(row + 1)
+	{
+		pipes.reserve(pts.lanes_n);
+		for (int lane = 0; lane < pts.lanes_n; ++lane)
+			pipes.emplace_back([&pts = pts, lane, row]() mutable { return pts.get(row++, lane); });
+	}
+
+	void in(mat& features)
+	{
+		for (int lane = 0; lane < pts.lanes_n; ++lane)
+			pipes[lane].in(features.col(lane));
+		row += features.n_rows / 2;
+	}
+
+	void out(const mat& output)
+	{
+		for (int lane = 0; lane < pts.lanes_n; ++lane)
+			pipes[lane].out(vec(output.col(lane)), LaneWriter{pts, lane, row});
+		row += output.n_rows / 2;
+	}
+};
+
+template<>
+struct BatchConverter<Mode::AnglesLengths>
+{
+	PointsSoA& pts;
+	int row;
+	vector<double> a, l;
+
+	BatchConverter(PointsSoA& pts, int row) : pts(pts), row(row + 2), a(block_lanes), l(block_lanes) {}
+
+	// lanes are processed in cache-sized blocks, the feature columns of a block are written while still hot
+	static constexpr int block_lanes = 256;
+
+	void in(mat& features)
+	{
+		for (int block = 0; block < pts.lanes_n; block += block_lanes)
+		{
+			int n = min(block_lanes, pts.lanes_n - block);
+
+			for (int i = 0, r = row; i < features.n_rows; i += 2, ++r)
+			{
+				const double *x0 = pts.X(r - 2) + block, *x1 = pts.X(r - 1) + block, *x2 = pts.X(r) + block;
+				const double *y0 = pts.Y(r - 2) + block, *y1 = pts.Y(r - 1) + block, *y2 = pts.Y(r) + block;
+
+				for (int j = 0; j < n; ++j)
+				{
+					double v1x = x1[j] - x0[j], v1y = y1[j] - y0[j];
+					double v2x = x2[j] - x1[j], v2y = y2[j] - y1[j];
+					a[j] = fast::atan2(v2y * v1x - v2x * v1y, v2x * v1x + v2y * v1y) * angle_scale;
+				}
+
+				// separate loop, mixing atan2 and rsqrt in one body defeats the auto-vectorizer
+				for (int j = 0; j < n; ++j)
+				{
+					double vx = x2[j] - x1[j], vy = y2[j] - y1[j];
+					double l2 = vx * vx + vy * vy;
+					l[j] = l2 * fast::rsqrt(l2) * coords_scale;
+				}
+
+				double* col = features.colptr(block) + i;
+				for (int j = 0; j < n; ++j, col += features.n_rows)
+					col[0] = a[j], col[1] = l[j];
+			}
+		}
+
+		row += features.n_rows / 2;
+	}
+
+	void out(const mat& output)
+	{
+		for (int block = 0; block < pts.lanes_n; block += block_lanes)
+		{
+			int n = min(block_lanes, pts.lanes_n - block);
+
+			for (int i = 0, r = row; i < output.n_rows; i += 2, ++r)
+			{
+				const double* col = output.colptr(block) + i;
+				for (int j = 0; j < n; ++j, col += output.n_rows)
+					a[j] = col[0] / angle_scale, l[j] = col[1] / coords_scale;
+
+				const double *x0 = pts.X(r - 2) + block, *x1 = pts.X(r - 1) + block;
+				const double *y0 = pts.Y(r - 2) + block, *y1 = pts.Y(r - 1) + block;
+				double *x2 = pts.X(r) + block, *y2 = pts.Y(r) + block;
+
+				for (int j = 0; j < n; ++j)
+				{
+					double vx = x1[j] - x0[j], vy = y1[j] - y0[j];
+					double k = fast::rsqrt(vx * vx + vy * vy) * l[j];
+					double s, c;
+					fast::sincos(a[j], s, c);
+					x2[j] = x1[j] + (vx * c - vy * s) * k;
+					y2[j] = y1[j] + (vy * c + vx * s) * k;
+				}
+			}
+		}
+
+		row += output.n_rows / 2;
+	}
+};
+
+using Pipe = TConverter<mode>;
+using BatchPipe = BatchConverter<mode>;
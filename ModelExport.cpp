@@ -0,0 +1,267 @@
+#include "pch.h"
+
+#include "PathProjectionNN.h"
+#include "Converters.h"
+
+using namespace arma;
+
+static constexpr int reference_windows_n = 16;
+static constexpr int reference_points_n = 10;
+
+static const char* header_prelude = R"(// Generated by PathProjectionNN::ExportHeader from a trained network, do not edit.
+// Standalone inference without mlpack or Armadillo: the weights are constexpr and every loop has constant bounds.
+#pragma once
+
+#include <cmath>
+
+namespace path_projection
+{
+	struct point { double x, y; };
+
+	// one mlpack Linear layer: Out x In weights in column-major order, then Out biases
+	template< int In, int Out >
+	struct layer
+	{
+		double weights[Out * In];
+		double biases[Out];
+	};
+
+	template< bool Tanh, int In, int Out >
+	inline void forward( const layer<In, Out>& l, const double (&x)[In], double (&y)[Out] )
+	{
+		for (int o = 0; o < Out; ++o)
+			y[o] = l.biases[o];
+
+		for (int i = 0; i < In; ++i)
+		for (int o = 0; o < Out; ++o)
+			y[o] += l.weights[i * Out + o] * x[i];
+
+		if constexpr (Tanh)
+			for (double& v : y) v = std::tanh(v);
+	}
+)";
+
+// TConverter<mode>::in over one window and out() after it, the same arithmetic in the same order
+static const char* converter_source( Mode mode )
+{
+	switch (mode)
+	{
+	case Mode::Points: return R"(
+	inline void encode( const point* window, double (&x)[features_n] )
+	{
+		point p0 = window[0];
+		for (int i = 0, t = 1; i < features_n; i += 2, ++t)
+			x[i] = p0.x - window[t].x, x[i + 1] = p0.y - window[t].y;
+	}
+
+	inline void decode( const point* window, const double (&y)[outputs_n], point* out )
+	{
+		point p0 = window[0];
+		for (int i = 0; i < outputs_n; i += 2)
+			*out++ = {p0.x + y[i], p0.y + y[i + 1]};
+	}
+)";
+
+	case Mode::Vectors: return R"(
+	inline void encode( const point* window, double (&x)[features_n] )
+	{
+		point p0 = window[0];
+		for (int i = 0, t = 1; i < features_n; i += 2, ++t)
+		{
+			point p1 = window[t];
+			x[i] = (p1.x - p0.x) * coords_scale, x[i + 1] = (p1.y - p0.y) * coords_scale;
+			p0 = p1;
+		}
+	}
+
+	inline void decode( const point* window, const double (&y)[outputs_n], point* out )
+	{
+		point p0 = window[input_points - 1];
+		for (int i = 0; i < outputs_n; i += 2)
+		{
+			p0 = {p0.x + y[i] / coords_scale, p0.y + y[i + 1] / coords_scale};
+			*out++ = p0;
+		}
+	}
+)";
+
+	case Mode::AnglesLengths: return R"(
+	inline void encode( const point* window, double (&x)[features_n] )
+	{
+		point p0 = window[0], p1 = window[1];
+		for (int i = 0, t = 2; i < features_n; i += 2, ++t)
+		{
+			point p2 = window[t];
+			point v1 = {p1.x - p0.x, p1.y - p0.y};
+			point v2 = {p2.x - p1.x, p2.y - p1.y};
+			p0 = p1, p1 = p2;
+
+			double k1 = 1. / std::sqrt(v1.x * v1.x + v1.y * v1.y);
+			v1 = {v1.x * k1, v1.y * k1};
+
+			x[i] = std::atan2(v2.y * v1.x - v2.x * v1.y, v2.x * v1.x + v2.y * v1.y) * angle_scale;
+			x[i + 1] = std::sqrt(v2.x * v2.x + v2.y * v2.y) * coords_scale;
+		}
+	}
+
+	inline void decode( const point* window, const double (&y)[outputs_n], point* out )
+	{
+		point p0 = window[input_points - 2], p1 = window[input_points - 1];
+		for (int i = 0; i < outputs_n; i += 2)
+		{
+			double angle = y[i] / angle_scale;
+			double length = y[i + 1] / coords_scale;
+
+			point v = {p1.x - p0.x, p1.y - p0.y};
+			double k = 1. / std::sqrt(v.x * v.x + v.y * v.y);
+			v = {v.x * k, v.y * k};
+
+			double c = std::cos(angle), s = std::sin(angle);
+			point v2 = {(v.x * c - v.y * s) * length, (v.y * c + v.x * s) * length};
+
+			p0 = p1;
+			p1 = {p1.x + v2.x, p1.y + v2.y};
+			*out++ = p1;
+		}
+	}
+)";
+	}
+
+	return "";
+}
+
+static const char* header_epilogue = R"(
+	// points_n points following the window, oldest first; the autoregressive loop of PathProjectionNN::Predict
+	template< int PointsN >
+	inline void predict( const point (&window)[input_points], point (&predicted)[PointsN] )
+	{
+		constexpr int steps_n = (PointsN + output_points - 1) / output_points;
+
+		point points[input_points + steps_n * output_points];
+		for (int i = 0; i < input_points; ++i)
+			points[i] = window[i];
+
+		double x[features_n], y[outputs_n];
+		for (int step = 0; step < steps_n; ++step)
+		{
+			const point* step_window = points + step * output_points;
+			encode(step_window, x);
+			network(x, y);
+			decode(step_window, y, points + input_points + step * output_points);
+		}
+
+		for (int i = 0; i < PointsN; ++i)
+			predicted[i] = points[input_points + i];
+	}
+
+	// largest distance in pixels between predict() and PathProjectionNN::Predict on the reference windows
+	inline double reference_error()
+	{
+		double error = 0;
+		for (int r = 0; r < reference_n; ++r)
+		{
+			point predicted[reference_points_n];
+			predict(reference_windows[r], predicted);
+
+			for (int i = 0; i < reference_points_n; ++i)
+				error = std::fmax(error, std::hypot(predicted[i].x - reference_predictions[r][i].x,
+													predicted[i].y - reference_predictions[r][i].y));
+		}
+		return error;
+	}
+}
+)";
+
+// exact round trip of doubles through the generated source
+static string double_literals( const double* values, size_t n )
+{
+	string text;
+	for (size_t i = 0; i < n; ++i)
+		text += format("{}{:.17g}", i == 0 ? "\n\t\t\t" : i % 8 ? ", " : ",\n\t\t\t", values[i]);
+	return text;
+}
+
+static string point_literals( const vector<vec2>& points )
+{
+	string text;
+	for (size_t i = 0; i < points.size(); ++i)
+		text += format("{}{{{:.17g}, {:.17g}}}", i ? ", " : "", points[i][0], points[i][1]);
+	return text;
+}
+
+bool PathProjectionNN::ExportHeader(ostream& stream)
+{
+	if (model != Model::FeedForward) return false;
+
+	// the layers added in the constructor, as (inputs, outputs, tanh after)
+	struct Layer { int in, out; bool tanh; };
+	Layer layers[] = {
+		{nn_input_size * 2, nn_input_size * 2, true},
+		{nn_input_size * 2, nn_input_size * 2, true},
+		{nn_input_size * 2, nn_output_size * 2, false}};
+
+	size_t parameters_n = ranges::fold_left(layers, 0ull, [](size_t n, const Layer& l) { return n + l.out * (l.in + 1); });
+
+	const mat& parameters = nn.Parameters();
+	if (parameters.n_elem != parameters_n) return false;
+
+	// reference windows: the worst training samples when there are any, otherwise arcs of a few curvatures
+	vector<vector<vec2>> windows;
+	for (auto& [error, sample] : views::reverse(dyn_samples))
+	{
+		if (windows.size() == reference_windows_n) break;
+		windows.emplace_back(sample.begin(), sample.begin() + input_size);
+	}
+
+	for (int w = windows.size(); w < reference_windows_n; ++w)
+	{
+		vector<vec2>& window = windows.emplace_back();
+		double radius = 50 + 40 * w, step = 6. / radius * (w % 2 ? 1 : -1);
+		for (int i = 0; i < input_size; ++i)
+			window.push_back(vec2{500 + radius * cos(i * step + w), 400 + radius * sin(i * step + w)});
+	}
+
+	stream << header_prelude;
+
+	stream << format(R"(
+	inline constexpr int input_points = {};
+	inline constexpr int output_points = {};
+	inline constexpr int features_n = {};
+	inline constexpr int outputs_n = {};
+	inline constexpr double coords_scale = {:.17g};
+	inline constexpr double angle_scale = {:.17g};
+)", input_size, output_size, nn_input_size * 2, nn_output_size * 2, coords_scale, angle_scale);
+
+	const double* p = parameters.memptr();
+	for (int i = 0; const Layer& l : layers)
+	{
+		stream << format("\n\tinline constexpr layer<{}, {}> layer_{} = {{\n\t\t{{{}\n\t\t}},\n\t\t{{{}\n\t\t}}}};\n",
+						 l.in, l.out, i++, double_literals(p, l.in * l.out), double_literals(p + l.in * l.out, l.out));
+		p += l.out * (l.in + 1);
+	}
+
+	stream << "\n\tinline void network( const double (&x)[features_n], double (&y)[outputs_n] )\n\t{\n";
+	for (int i = 0; i < size(layers) - 1; ++i)
+		stream << format("\t\tdouble h{}[{}];\n\t\tforward<{}>(layer_{}, {}, h{});\n",
+						 i, layers[i].out, layers[i].tanh, i, i ? format("h{}", i - 1) : "x", i);
+	stream << format("\t\tforward<{}>(layer_{}, h{}, y);\n\t}}\n", layers[size(layers) - 1].tanh, size(layers) - 1, size(layers) - 2);
+
+	stream << converter_source(mode);
+
+	stream << format("\n\tinline constexpr int reference_n = {};\n\tinline constexpr int reference_points_n = {};\n",
+					 reference_windows_n, reference_points_n);
+
+	stream << "\n\tinline constexpr point reference_windows[reference_n][input_points] = {";
+	for (const vector<vec2>& window : windows)
+		stream << "\n\t\t{" << point_literals(window) << "},";
+	stream << "\n\t};\n";
+
+	stream << "\n\tinline constexpr point reference_predictions[reference_n][reference_points_n] = {";
+	for (const vector<vec2>& window : windows)
+		stream << "\n\t\t{" << point_literals(Predict(reference_points_n, [it = window.begin()]() mutable { return *(it++); })) << "},";
+	stream << "\n\t};\n";
+
+	stream << header_epilogue;
+
+	return bool(stream);
+}
@@ -1,153 +1,37 @@
 #include "pch.h"
 
 #include "PathProjectionNN.h"
+#include "RecurrentModel.h"
+#include "Converters.h"
+#include "Trace.h"
 
 using namespace arma;
 using namespace mlpack;
 
-enum class Mode { Points, Vectors, AnglesLengths };
-
-static constexpr Mode mode = Mode::AnglesLengths;
-
-static constexpr double opt_step = 0.0004;
-static constexpr int batch_size = 400;
-static constexpr int max_iterations = 5000000;
-static constexpr double beta1 = 0.9;
-static constexpr double beta2 = 0.999999;
-
-static constexpr double coords_scale = 0.1;
-static constexpr double angle_scale = 10;
-
-static constexpr int dynamic_training_samples_n = max(1000, batch_size);
-
-static double length( const vec2& v ) { return sqrt(dot(v, v)); }
-static double cross( const vec2& v1, const vec2& v2 ) { return v1[1] * v2[0] - v1[0] * v2[1]; }
-static bool equal( const vec2& v1, const vec2& v2 ) { return v1[0] == v2[0] && v1[1] == v2[1]; }
-
-template< typename type = double >
-vec2 normalized( const vec2& v, type&& len = double() )
-{
-	len = length(v);
-	double k = 1. / len;
-	return {v[0] * k, v[1] * k};
-}
-
-static double angle( const vec2& v1, const vec2& v2 )
-{
-	double d = dot(v1, v2);
-	double c = cross(v1, v2);
-	return atan2(c, d);
-}
-
-static vec2 rotate( const vec2& v, const vec2& rot )
-{
-	return {v[0] * rot[0] - v[1] * rot[1], v[1] * rot[0] + v[0] * rot[1]};
-}
-
-template<Mode> struct TConverter;
-
-template<>
-struct TConverter<Mode::Points>
-{
-	vec2 p0;
-	function<vec2()> next;
-	TConverter(function<vec2()>&& next) : next(move(next)) { p0 = this->next(); }
-
-	void in(subview_col<double>&& col)
-	{
-		for (int i = 0; i < col.n_rows;)
-		{
-			vec2 v = p0 - next();
-			col[i++] = v[0], col[i++] = v[1];
-		}
-	}
-
-	void out(const vec& output, auto&& it)
-	{
-		for (int i = 0; i < output.n_rows; i += 2)
-			*it = p0 + vec2{output[i], output[i + 1]};
-	}
-};
-
-template<>
-struct TConverter<Mode::Vectors>
-{
-	vec2 p0;
-	function<vec2()> next;
-	TConverter(function<vec2()>&& next) : next(move(next)) { p0 = this->next(); }
-
-	void in(subview_col<double>&& col)
-	{
-		for (int i = 0; i < col.n_rows;)
-		{
-			vec2 p1 = next();
-			vec2 v = (p1 - p0) * coords_scale;
-			p0 = p1;
-			col[i++] = v[0], col[i++] = v[1];
-		}
-	}
-
-	void out(const vec& output, auto&& it)
-	{
-		for (int i = 0; i < output.n_rows; i += 2)
-			*it = (p0 += vec2{output[i], output[i + 1]} / coords_scale);
-	}
-};
-
-template<>
-struct TConverter<Mode::AnglesLengths>
-{
-	vec2 p0, p1;
-	function<vec2()> next;
-	TConverter(function<vec2()>&& next) : next(move(next)) { p0 = this->next(), p1 = this->next(); }
-	
-	void in(subview_col<double>&& col)
-	{
-		for (int i = 0; i < col.n_rows;)
-		{
-			vec2 p2 = next();
-			vec2 v1 = p1 - p0;
-			vec2 v2 = p2 - p1;
-			p0 = p1, p1 = p2;
-
-			double l1, l2;
-			v1 = normalized(v1, l1);
-			v2 - normalized(v2, l2);
-
-			col[i++] = angle(v2, v1) * angle_scale;
-			col[i++] = l2 * coords_scale;
-		}
-	}
-
-	void out(const vec& output, auto&& it)
-	{
-		for (int i = 0; i < output.n_rows; i += 2)
-		{
-			double angle = output[i] / angle_scale;
-			vec2 v2 = rotate(normalized(p1 - p0), vec2{cos(angle), sin(angle)}) * (output [i + 1] / coords_scale);
-			p0 = p1;
-			p1 += v2;
-			*it = p1;
-		}
-	}
-};
-
-using Pipe = TConverter<mode>;
+static constexpr int dynamic_training_samples_n = max(1000, PathProjectionNN::TrainingOptions().batch_size);
 
 struct OptimizationCallbacks
 {
 	const function<void(int, double)>& end_epoch;
 	const function<void()>& end_optimization;
+	int64_t epoch_start = TRACE_NOW();
 
 	void EndEpoch(auto& opt, auto& func, const mat& coords, size_t epoch, double loss)
-		{ if (end_epoch) end_epoch(epoch, loss); }
+	{
+		TRACE_RECORD("train.epoch", epoch_start);
+		if (end_epoch) end_epoch(epoch, loss);
+		epoch_start = TRACE_NOW();
+	}
 
 	void EndOptimization(auto& opt, auto& func, mat& coords)
 		{ if (end_optimization) end_optimization(); }
 };
 
-PathProjectionNN::PathProjectionNN()
+PathProjectionNN::PathProjectionNN(Model model) : model(model)
 {
+	if (model == Model::Recurrent)
+		recurrent = make_unique<RecurrentModel>();
+
 	switch (mode)
 	{
 	case Mode::Points: nn_input_size = input_size - 1; break;
@@ -164,25 +48,64 @@ PathProjectionNN::PathProjectionNN()
 	nn.Add<Linear>(nn_output_size * 2);
 }
 
-double PathProjectionNN::Train(const vector<vector<vec2>>& raw_sequences, 
-							   const function<void(int, double)>& epoch_callback,
-							   const function<void()>& end_optimization)
+PathProjectionNN::~PathProjectionNN() = default;
+
+void PathProjectionNN::SetTrainingOptions(const TrainingOptions& options)
 {
+	training_options = options;
+}
+
+int PathProjectionNN::BuildSamples(const vector<vector<vec2>>& raw_sequences, mat& input, mat& output)
+{
+	TRACE_SCOPE("train.samples");
+
 	int sample_length = input_size + output_size;
 
 	int samples_n = ranges::fold_left(raw_sequences, 0, 
 		[&](int n, const vector<vec2>& seq){ return n + max(0ull, seq.size() - sample_length); });
 
-	mat input(nn_input_size * 2, samples_n);
-	mat output(nn_output_size * 2, samples_n);
+	input.set_size(nn_input_size * 2, samples_n);
+	output.set_size(nn_output_size * 2, samples_n);
+
+	PointsSoA samples(samples_n, sample_length);
 
 	for (int sample_i = 0; const vector<vec2>& seq : raw_sequences)
 	for (int i = 0; i < int(seq.size() - sample_length); ++i, ++sample_i)
-	{
-		Pipe pipe([it = seq.begin() + i]() mutable { return *(it++); });
-		pipe.in(input.col(sample_i));
-		pipe.in(output.col(sample_i));
-	}
+	for (int t = 0; t < sample_length; ++t)
+		samples.set(t, sample_i, seq[i + t]);
+
+	BatchPipe pipe(samples, 0);
+	pipe.in(input);
+	pipe.in(output);
+
+	return samples_n;
+}
+
+void PathProjectionNN::Optimize(const mat& input, const mat& output,
+								const function<void(int, double)>& epoch_callback,
+								const function<void()>& end_optimization)
+{
+	TRACE_SCOPE("train.optimization");
+
+	ens::OptimisticAdam optimizer;
+	optimizer.StepSize() = training_options.step_size;
+	optimizer.BatchSize() = training_options.batch_size;
+	optimizer.MaxIterations() = training_options.max_iterations;
+	optimizer.Beta1() = training_options.beta1;
+	optimizer.Beta2() = training_options.beta2;
+
+	nn.Train(input, output, optimizer, OptimizationCallbacks{epoch_callback, end_optimization});
+}
+
+optional<double> PathProjectionNN::Train(const vector<vector<vec2>>& raw_sequences, 
+										 const function<void(int, double)>& epoch_callback,
+										 const function<void()>& end_optimization)
+{
+	int sample_length = input_size + output_size;
+
+	mat input, output;
+	if (model == Model::FeedForward && BuildSamples(raw_sequences, input, output) == 0)
+		return nullopt;
 
 	/*double max_x = 0, max_y = 0;
 	for (int i = 0; i < output.n_cols; i++)
@@ -195,22 +118,30 @@ double PathProjectionNN::Train(const vector<vector<vec2>>& raw_sequences,
 	max_x /= output.n_cols;
 	max_y /= output.n_cols;*/
 
-	ens::OptimisticAdam optimizer;
-	optimizer.StepSize() = opt_step;
-	optimizer.BatchSize() = batch_size;
-	optimizer.MaxIterations() = max_iterations;
-	optimizer.Beta1() = beta1;
-	optimizer.Beta2() = beta2;
+	if (model == Model::Recurrent)
+	{
+		if (!recurrent->Train(raw_sequences, training_options, epoch_callback, end_optimization))
+			return nullopt;
+	}
+	else
+		Optimize(input, output, epoch_callback, end_optimization);
 
-	nn.Train(input, output, optimizer, OptimizationCallbacks{epoch_callback, end_optimization});
+	TRACE_SCOPE("train.evaluation");
 
 	double training_samples_error = 0;
 	int error_n = 0;
 
+	vector<function<vec2()>> feeders;
 	for (const vector<vec2>& seq : raw_sequences)
 	for (auto it = seq.begin(); it < seq.end() - sample_length; ++it)
+		feeders.push_back([it = it]() mutable { return *it++; });
+
+	vector<vector<vec2>> samples_predictions = Predict(output_size, feeders);
+
+	for (int sample_i = 0; const vector<vec2>& seq : raw_sequences)
+	for (auto it = seq.begin(); it < seq.end() - sample_length; ++it, ++sample_i)
 	{
-		vector<vec2> prediction = Predict(output_size, [it = it]() mutable { return *it++; });
+		const vector<vec2>& prediction = samples_predictions[sample_i];
 		for (int j = 0; j < prediction.size(); j++)
 		{
 			double error = length(*(it + input_size + j) - prediction[j]);
@@ -230,6 +161,20 @@ double PathProjectionNN::Train(const vector<vector<vec2>>& raw_sequences,
 
 vector<vec2> PathProjectionNN::Predict(int points_n, const function<vec2()>& feeder)
 {
+	TRACE_SCOPE("predict");
+
+	if (model == Model::Recurrent)
+	{
+		vector<vec2> window(input_size);
+		ranges::generate(window, feeder);
+
+		vec hidden;
+		for (int i = 2; i < input_size; ++i)
+			recurrent->Step(hidden, window[i - 2], window[i - 1], window[i]);
+
+		return recurrent->Rollout(hidden, window[input_size - 2], window[input_size - 1], points_n);
+	}
+
 	vector<vec2> points;
 	points.reserve(input_size + (points_n / output_size + 1) * output_size);
 
@@ -242,15 +187,128 @@ vector<vec2> PathProjectionNN::Predict(int points_n, const function<vec2()>& fee
 	for (int i = 0; i < points_n; i += output_size)
 	{
 		Pipe pipe([it = points.begin() + i]() mutable { return *(it++); });
-		pipe.in(input.col(0));
-		nn.Predict(input, output);
-		pipe.out(output, back_insert_iterator(points));
+		{ TRACE_SCOPE("encode"); pipe.in(input.col(0)); }
+		{ TRACE_SCOPE("nn.Predict"); nn.Predict(input, output); }
+		{ TRACE_SCOPE("decode"); pipe.out(output, back_insert_iterator(points)); }
 	}
 
 	points.erase(points.begin(), points.begin() + input_size);
 	return points;
 }
 
+vector<vector<vec2>> PathProjectionNN::Predict(int points_n, const vector<function<vec2()>>& feeders)
+{
+	TRACE_SCOPE("batch.predict");
+
+	int lanes_n = feeders.size();
+	if (lanes_n == 0) return {};
+
+	// the recurrent model steps each lane on its own
+	if (model == Model::Recurrent)
+	{
+		vector<vector<vec2>> paths;
+		paths.reserve(lanes_n);
+		for (const function<vec2()>& feeder : feeders)
+			paths.push_back(Predict(points_n, feeder));
+		return paths;
+	}
+
+	PointsSoA points(lanes_n, input_size + (points_n + output_size - 1) / output_size * output_size);
+
+	for (int lane = 0; lane < lanes_n; ++lane)
+	for (int t = 0; t < input_size; ++t)
+		points.set(t, lane, feeders[lane]());
+
+	mat input(nn_input_size * 2, lanes_n);
+	mat output(nn_output_size * 2, lanes_n);
+
+	for (int i = 0; i < points_n; i += output_size)
+	{
+		BatchPipe pipe(points, i);
+		{ TRACE_SCOPE("batch.encode"); pipe.in(input); }
+		{ TRACE_SCOPE("batch.nn.Predict"); nn.Predict(input, output); }
+		{ TRACE_SCOPE("batch.decode"); pipe.out(output); }
+	}
+
+	vector<vector<vec2>> paths(lanes_n);
+	for (int lane = 0; lane < lanes_n; ++lane)
+	{
+		paths[lane].reserve(points.rows_n - input_size);
+		for (int t = input_size; t < points.rows_n; ++t)
+			paths[lane].push_back(points.get(t, lane));
+	}
+
+	return paths;
+}
+
+void PathProjectionNN::SetSamplePeriod(chrono::microseconds period)
+{
+	sample_period = period;
+}
+
+int PathProjectionNN::GetHorizonPoints(chrono::microseconds horizon, chrono::microseconds since_last_sample)
+{
+	return max<int>(0, (horizon + since_last_sample + sample_period - 1us) / sample_period);
+}
+
+vector<vec2> PathProjectionNN::Predict(chrono::microseconds horizon, const function<vec2()>& feeder, chrono::microseconds since_last_sample)
+{
+	return Predict(GetHorizonPoints(horizon, since_last_sample), feeder);
+}
+
+void PathProjectionNN::Observe(int player_id, const vec2& point)
+{
+	TRACE_SCOPE("observe");
+
+	PlayerState& player = players[player_id];
+	player.observed_n++;
+
+	if (model == Model::Recurrent)
+	{
+		if (player.points.size() == 2)
+		{
+			recurrent->Step(player.hidden, player.points[0], player.points[1], point);
+			player.points.erase(player.points.begin());
+		}
+	}
+	else if (player.points.size() == input_size)
+		player.points.erase(player.points.begin());
+
+	player.points.push_back(point);
+}
+
+vector<vec2> PathProjectionNN::PredictPlayer(int player_id, int points_n)
+{
+	auto it = players.find(player_id);
+	if (it == players.end() || it->second.observed_n < input_size) return {};
+
+	const PlayerState& player = it->second;
+
+	if (model == Model::Recurrent)
+		return recurrent->Rollout(player.hidden, player.points[0], player.points[1], points_n);
+
+	return Predict(points_n, [it = player.points.begin()]() mutable { return *(it++); });
+}
+
+vector<vec2> PathProjectionNN::PredictPlayer(int player_id, chrono::microseconds horizon, chrono::microseconds since_last_sample)
+{
+	return PredictPlayer(player_id, GetHorizonPoints(horizon, since_last_sample));
+}
+
+void PathProjectionNN::ResetPlayer(int player_id)
+{
+	players.erase(player_id);
+}
+
+size_t PathProjectionNN::GetPlayerStateBytes(int player_id)
+{
+	auto it = players.find(player_id);
+	if (it == players.end()) return 0;
+
+	const PlayerState& player = it->second;
+	return sizeof(PlayerState) + player.points.capacity() * sizeof(vec2) + player.hidden.n_elem * sizeof(double);
+}
+
 void PathProjectionNN::Add()
 {
 	for (auto it = predictions.begin(); it != predictions.end();)
@@ -305,10 +363,24 @@ int PathProjectionNN::GetInputSize()
 
 void PathProjectionNN::WriteNN(ostream& stream)
 {
-	nn.Parameters().save(stream);
+	if (model == Model::Recurrent)
+		recurrent->Write(stream);
+	else
+		nn.Parameters().save(stream);
 }
 
-void PathProjectionNN::ReadNN(istream& stream)
+bool PathProjectionNN::ReadNN(istream& stream)
 {
-	nn.Parameters().load(stream);
+	if (model == Model::Recurrent)
+		return recurrent->Read(stream);
+
+	// the layers added in the constructor
+	size_t hidden_n = nn_input_size * 2, outputs_n = nn_output_size * 2;
+	size_t parameters_n = 2 * hidden_n * (hidden_n + 1) + outputs_n * (hidden_n + 1);
+
+	mat loaded;
+	if (!loaded.load(stream) || loaded.n_elem != parameters_n) return false;
+
+	nn.Parameters() = loaded;
+	return true;
 }
\ No newline at end of file
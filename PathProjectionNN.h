@@ -2,12 +2,30 @@
 
 #include <vector>
 #include <array>
+#include <optional>
 #include <mlpack.hpp>
 
+#include "Resampler.h"
+
 using namespace std;
 
 class PathProjectionNN
 {
+public:
+	// the feed-forward model trains on every input_size + output_size point window; the recurrent one on
+	// chunks of RecurrentModel::chunk_points points, a shorter sequence down to min_chunk_points as one chunk
+	enum class Model { FeedForward, Recurrent };
+
+	struct TrainingOptions
+	{
+		double step_size = 0.0004;
+		int batch_size = 400;
+		size_t max_iterations = 5000000;
+		double beta1 = 0.9;
+		double beta2 = 0.999999;
+	};
+
+private:
 	static constexpr int input_size = 12;
 	static constexpr int output_size = 1;
 
@@ -18,15 +36,59 @@ class PathProjectionNN
 	map<int, array<arma::vec2, output_size>> predictions;
 	map<double, array<arma::vec2, input_size + output_size>> dyn_samples;
 	vector<arma::vec2> path;
+
+	TrainingOptions training_options;
+
+	// time between consecutive points of the sequences the model sees
+	chrono::microseconds sample_period = Resampler::Config().period;
+
+	Model model;
+	unique_ptr<class RecurrentModel> recurrent;
+
+	// streaming state of one cursor: the last input_size points for the feed-forward model,
+	// the last two points and the hidden state for the recurrent one
+	struct PlayerState
+	{
+		vector<arma::vec2> points;
+		arma::vec hidden;
+		int observed_n = 0;
+	};
+
+	map<int, PlayerState> players;
 	
 public:
-	PathProjectionNN();
+	PathProjectionNN(Model model = Model::FeedForward);
+	~PathProjectionNN();
+
+	void SetTrainingOptions(const TrainingOptions& options);
+
+	int BuildSamples(const vector<vector<arma::vec2>>& raw_sequences, arma::mat& input, arma::mat& output);
 
-	double Train(const vector<vector<arma::vec2>>& raw_sequences, 
-				 const function<void(int, double)>& epoch_callback,
-				 const function<void()>& end_optimization);
+	void Optimize(const arma::mat& input, const arma::mat& output,
+				  const function<void(int, double)>& epoch_callback,
+				  const function<void()>& end_optimization);
+
+	// error on the training samples, nullopt without training when no sequence is long enough for the model
+	optional<double> Train(const vector<vector<arma::vec2>>& raw_sequences, 
+						   const function<void(int, double)>& epoch_callback,
+						   const function<void()>& end_optimization);
 
 	vector<arma::vec2> Predict(int points_n, const function<arma::vec2()>& feeder);
+	vector<vector<arma::vec2>> Predict(int points_n, const vector<function<arma::vec2()>>& feeders);
+
+	// horizon-targeted variants: exactly the points, and rollout steps, that reach the horizon at the sample period.
+	// The rollout starts at the last sample, since_last_sample before the time the horizon is counted from
+	void SetSamplePeriod(chrono::microseconds period);
+	int GetHorizonPoints(chrono::microseconds horizon, chrono::microseconds since_last_sample = {});
+	vector<arma::vec2> Predict(chrono::microseconds horizon, const function<arma::vec2()>& feeder,
+							   chrono::microseconds since_last_sample = {});
+
+	// per-player incremental prediction: Observe() every new point, PredictPlayer() from the state so far
+	void Observe(int player_id, const arma::vec2& point);
+	vector<arma::vec2> PredictPlayer(int player_id, int points_n);
+	vector<arma::vec2> PredictPlayer(int player_id, chrono::microseconds horizon, chrono::microseconds since_last_sample = {});
+	void ResetPlayer(int player_id);
+	size_t GetPlayerStateBytes(int player_id);
 
 	void Add();
 	void DynTrain();
@@ -41,5 +103,9 @@ public:
 	}
 
 	void WriteNN(ostream& stream);
-	void ReadNN(istream& stream);
+	// false, leaving the model untrained, when the stream holds no parameters of the selected model
+	bool ReadNN(istream& stream);
+
+	// writes the feed-forward network as a standalone C++ header (see ModelExport.cpp), false for the recurrent model
+	bool ExportHeader(ostream& stream);
 };
@@ -0,0 +1,256 @@
+#include "pch.h"
+
+#include "RecurrentModel.h"
+#include "Converters.h"
+#include "Trace.h"
+
+using namespace arma;
+
+static constexpr int hidden_size = RecurrentModel::hidden_size;
+static constexpr int features_n = RecurrentModel::features_n;
+
+// gate rows of the stacked W, U and b: update (z), reset (r), candidate (n)
+static constexpr int gates_n = 3 * hidden_size;
+static constexpr int z_row = 0, r_row = hidden_size, n_row = 2 * hidden_size;
+
+static mat sigmoid( const mat& x ) { return 1 / (1 + exp(-x)); }
+
+// all weights are views into one flat parameter vector, the same layout mlpack uses for its layers
+RecurrentModel::Weights::Weights(double* p)
+	: W(p, gates_n, features_n, false, true),
+	  U(p + gates_n * features_n, gates_n, hidden_size, false, true),
+	  Wy(p + gates_n * (features_n + hidden_size), features_n, hidden_size, false, true),
+	  b(p + gates_n * (features_n + hidden_size) + features_n * hidden_size, gates_n, false, true),
+	  by(p + gates_n * (features_n + hidden_size + 1) + features_n * hidden_size, features_n, false, true)
+{
+}
+
+RecurrentModel::RecurrentModel()
+	: parameters(parameters_n, fill::zeros), gradient(parameters_n, fill::zeros),
+	  weights(parameters.memptr()), gradients(gradient.memptr())
+{
+	weights.W = randn<mat>(gates_n, features_n) * sqrt(1. / features_n);
+	weights.U = randn<mat>(gates_n, hidden_size) * sqrt(1. / hidden_size);
+	weights.Wy = randn<mat>(features_n, hidden_size) * sqrt(1. / hidden_size);
+}
+
+void RecurrentModel::Forward(const mat& x, const mat& h_prev, StepCache& cache) const
+{
+	mat a = weights.W * x;
+	a.each_col() += weights.b;
+	mat u = weights.U * h_prev;
+
+	cache.x = x;
+	cache.h_prev = h_prev;
+	cache.z = sigmoid(a.rows(z_row, z_row + hidden_size - 1) + u.rows(z_row, z_row + hidden_size - 1));
+	cache.r = sigmoid(a.rows(r_row, r_row + hidden_size - 1) + u.rows(r_row, r_row + hidden_size - 1));
+	cache.un = u.rows(n_row, n_row + hidden_size - 1);
+	cache.n = tanh(a.rows(n_row, n_row + hidden_size - 1) + cache.r % cache.un);
+	cache.h = cache.n + cache.z % (h_prev - cache.n);
+}
+
+mat RecurrentModel::Head(const mat& h) const
+{
+	mat y = weights.Wy * h;
+	y.each_col() += weights.by;
+	return y;
+}
+
+// mean squared error of next-pair predictions over one batch of chunks, one chunk per column
+double RecurrentModel::Gradient(const mat& batch)
+{
+	int steps_n = batch.n_rows / features_n - 1;
+	int batch_n = batch.n_cols;
+	double norm = 1. / (double(steps_n - warmup_steps) * features_n * batch_n);
+
+	vector<StepCache> caches(steps_n);
+	vector<mat> errors(steps_n);
+	mat h(hidden_size, batch_n, fill::zeros);
+	double loss = 0;
+
+	for (int t = 0; t < steps_n; ++t)
+	{
+		Forward(batch.rows(t * features_n, (t + 1) * features_n - 1), h, caches[t]);
+		h = caches[t].h;
+
+		if (t < warmup_steps) continue;
+
+		errors[t] = Head(h) - batch.rows((t + 1) * features_n, (t + 2) * features_n - 1);
+		loss += accu(square(errors[t])) * norm;
+	}
+
+	gradient.zeros();
+	mat dh(hidden_size, batch_n, fill::zeros);
+
+	for (int t = steps_n - 1; t >= 0; --t)
+	{
+		const StepCache& c = caches[t];
+
+		if (t >= warmup_steps)
+		{
+			mat dy = errors[t] * (2 * norm);
+			gradients.Wy += dy * c.h.t();
+			gradients.by += sum(dy, 1);
+			dh += weights.Wy.t() * dy;
+		}
+
+		mat dan = dh % (1 - c.z) % (1 - square(c.n));
+		mat daz = dh % (c.h_prev - c.n) % c.z % (1 - c.z);
+		mat dar = dan % c.un % c.r % (1 - c.r);
+
+		mat da = join_cols(daz, dar, dan);
+		mat du = join_cols(daz, dar, dan % c.r);
+
+		gradients.W += da * c.x.t();
+		gradients.b += sum(da, 1);
+		gradients.U += du * c.h_prev.t();
+
+		dh = dh % c.z + weights.U.t() * du;
+	}
+
+	return loss;
+}
+
+bool RecurrentModel::Train(const vector<vector<vec2>>& raw_sequences,
+						   const PathProjectionNN::TrainingOptions& options,
+						   const function<void(int, double)>& epoch_callback,
+						   const function<void()>& end_optimization)
+{
+	// chunk starts by chunk length: strided chunk_points chunks of the long sequences, whole short ones
+	map<int, vector<const vec2*>> chunk_starts;
+	for (const vector<vec2>& seq : raw_sequences)
+	{
+		if (seq.size() >= chunk_points)
+			for (int i = 0; i + chunk_points <= int(seq.size()); i += chunk_stride)
+				chunk_starts[chunk_points].push_back(seq.data() + i);
+		else if (seq.size() >= min_chunk_points)
+			chunk_starts[seq.size()].push_back(seq.data());
+	}
+
+	if (chunk_starts.empty())
+	{
+		if (end_optimization) end_optimization();
+		return false;
+	}
+
+	// one feature matrix per chunk length, a batch never mixes lengths
+	vector<mat> features;
+
+	{
+		TRACE_SCOPE("train.samples");
+
+		for (const auto& [points_n, starts] : chunk_starts)
+		{
+			PointsSoA chunks(starts.size(), points_n);
+
+			for (int chunk_i = 0; chunk_i < starts.size(); ++chunk_i)
+			for (int t = 0; t < points_n; ++t)
+				chunks.set(t, chunk_i, starts[chunk_i][t]);
+
+			mat& length_features = features.emplace_back((points_n - 2) * features_n, starts.size());
+			BatchConverter<Mode::AnglesLengths> pipe(chunks, 0);
+			pipe.in(length_features);
+		}
+	}
+
+	TRACE_SCOPE("train.optimization");
+
+	// plain Adam, hyper-parameters and iteration counting as in ensmallen (max_iterations counts samples, 0 is unlimited)
+	size_t max_iterations = options.max_iterations ? options.max_iterations : SIZE_MAX;
+	vec m(parameters_n, fill::zeros), v(parameters_n, fill::zeros);
+	double beta1_t = 1, beta2_t = 1;
+
+	for (size_t epoch = 1, visited = 0; visited < max_iterations; ++epoch)
+	{
+		int64_t epoch_start = TRACE_NOW();
+
+		// shuffled chunks of every length cut into batches, then the batches shuffled across lengths
+		vector<pair<int, uvec>> batches;
+		for (int length_i = 0; length_i < features.size(); ++length_i)
+		{
+			uvec order = shuffle(regspace<uvec>(0, features[length_i].n_cols - 1));
+			for (int first = 0; first < order.n_elem; first += options.batch_size)
+				batches.push_back({length_i, order.subvec(first, min<int>(first + options.batch_size, order.n_elem) - 1)});
+		}
+
+		double epoch_loss = 0;
+		int batches_n = 0;
+
+		uvec batch_order = shuffle(regspace<uvec>(0, batches.size() - 1));
+		for (int i = 0; i < batch_order.n_elem && visited < max_iterations; ++i)
+		{
+			auto& [length_i, columns] = batches[batch_order[i]];
+			epoch_loss += Gradient(features[length_i].cols(columns));
+			visited += columns.n_elem;
+			++batches_n;
+
+			beta1_t *= options.beta1;
+			beta2_t *= options.beta2;
+			m = options.beta1 * m + (1 - options.beta1) * gradient;
+			v = options.beta2 * v + (1 - options.beta2) * square(gradient);
+			parameters -= options.step_size * (m / (1 - beta1_t)) / (sqrt(v / (1 - beta2_t)) + 1e-8);
+		}
+
+		TRACE_RECORD("train.epoch", epoch_start);
+		if (epoch_callback) epoch_callback(epoch, epoch_loss / batches_n);
+	}
+
+	if (end_optimization) end_optimization();
+	return true;
+}
+
+void RecurrentModel::Step(vec& hidden, const vec2& p0, const vec2& p1, const vec2& p2) const
+{
+	TRACE_SCOPE("recurrent.step");
+
+	if (hidden.n_elem != hidden_size) hidden.zeros(hidden_size);
+
+	vec2 v1 = p1 - p0, v2 = p2 - p1;
+	vec x = {angle(v2, v1) * angle_scale, length(v2) * coords_scale};
+
+	StepCache cache;
+	Forward(x, hidden, cache);
+	hidden = cache.h;
+}
+
+vector<vec2> RecurrentModel::Rollout(vec hidden, vec2 p0, vec2 p1, int points_n) const
+{
+	TRACE_SCOPE("recurrent.rollout");
+
+	if (hidden.n_elem != hidden_size) hidden.zeros(hidden_size);
+
+	vector<vec2> points;
+	points.reserve(points_n);
+
+	StepCache cache;
+	for (int i = 0; i < points_n; ++i)
+	{
+		vec y = Head(hidden);
+
+		double a = y[0] / angle_scale;
+		vec2 p2 = p1 + rotate(normalized(p1 - p0), vec2{cos(a), sin(a)}) * (y[1] / coords_scale);
+		points.push_back(p2);
+
+		// the predicted pair is the encoding of p2, it goes straight back in without re-encoding
+		Forward(y, hidden, cache);
+		hidden = cache.h;
+		p0 = p1, p1 = p2;
+	}
+
+	return points;
+}
+
+void RecurrentModel::Write(ostream& stream)
+{
+	parameters.save(stream);
+}
+
+bool RecurrentModel::Read(istream& stream)
+{
+	vec loaded;
+	if (!loaded.load(stream) || loaded.n_elem != parameters_n) return false;
+
+	// copy into the existing memory, the weight views point into it
+	parameters = loaded;
+	return true;
+}
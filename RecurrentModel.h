@@ -0,0 +1,65 @@
+#pragma once
+
+#include "PathProjectionNN.h"
+
+// GRU over AnglesLengths feature pairs with a linear head that predicts the next pair. The hidden state
+// carries the whole history, so a new point costs one encoder step and one recurrent step regardless of
+// the window length, and rollouts continue from the state instead of re-reading the window.
+// Trained with truncated backpropagation through time over fixed-length chunks of the raw sequences.
+class RecurrentModel
+{
+public:
+	static constexpr int features_n = 2;
+	static constexpr int hidden_size = 16;
+
+	// points per training chunk, the first two only seed the feature encoder
+	static constexpr int chunk_points = 34;
+	static constexpr int chunk_stride = 8;
+
+	// steps excluded from the loss while the hidden state settles from zero
+	static constexpr int warmup_steps = 4;
+
+	// a sequence shorter than chunk_points trains as one chunk of its own length, down to a single step after warmup
+	static constexpr int min_chunk_points = warmup_steps + 4;
+
+private:
+	struct Weights
+	{
+		arma::mat W, U, Wy;
+		arma::vec b, by;
+		Weights(double* p);
+	};
+
+	struct StepCache
+	{
+		arma::mat x, h_prev, z, r, un, n, h;
+	};
+
+	arma::vec parameters, gradient;
+	Weights weights, gradients;
+
+	void Forward(const arma::mat& x, const arma::mat& h_prev, StepCache& cache) const;
+	arma::mat Head(const arma::mat& h) const;
+	double Gradient(const arma::mat& features);
+
+public:
+	static constexpr size_t parameters_n = 3 * hidden_size * (features_n + hidden_size + 1) + features_n * (hidden_size + 1);
+
+	RecurrentModel();
+	RecurrentModel(const RecurrentModel&) = delete;
+
+	// false, without training, when no sequence has min_chunk_points points
+	bool Train(const vector<vector<arma::vec2>>& raw_sequences,
+			   const PathProjectionNN::TrainingOptions& options,
+			   const function<void(int, double)>& epoch_callback,
+			   const function<void()>& end_optimization);
+
+	// advances the hidden state by the point p2 that follows p0 and p1
+	void Step(arma::vec& hidden, const arma::vec2& p0, const arma::vec2& p1, const arma::vec2& p2) const;
+
+	vector<arma::vec2> Rollout(arma::vec hidden, arma::vec2 p0, arma::vec2 p1, int points_n) const;
+
+	void Write(ostream& stream);
+	// false, keeping the current weights, when the stream holds no parameters_n vector
+	bool Read(istream& stream);
+};
@@ -0,0 +1,56 @@
+#include "pch.h"
+
+#include "Resampler.h"
+
+using namespace chrono;
+
+Resampler::Resampler() : Resampler(Config())
+{
+}
+
+Resampler::Resampler(Config config) : config(config)
+{
+}
+
+bool Resampler::Push(const arma::vec2& point, system_clock::time_point time, vector<arma::vec2>& samples)
+{
+	if (!started || time < last_time || time - last_time > config.max_gap)
+	{
+		started = true;
+		last_point = point;
+		last_time = time;
+		next_time = time + config.period;
+		samples.push_back(point);
+		return true;
+	}
+
+	// next_time > last_time, so the span is never empty when a sample is due
+	for (; next_time <= time; next_time += config.period)
+	{
+		double k = duration<double>(next_time - last_time) / duration<double>(time - last_time);
+		samples.push_back(last_point + (point - last_point) * k);
+	}
+
+	last_point = point;
+	last_time = time;
+	return false;
+}
+
+vector<vector<arma::vec2>> Resampler::Resample(const vector<arma::vec2>& points,
+											   const vector<system_clock::time_point>& times,
+											   const Config& config)
+{
+	vector<vector<arma::vec2>> sequences;
+	vector<arma::vec2> samples;
+	Resampler resampler(config);
+
+	for (size_t i = 0; i < points.size() && i < times.size(); ++i)
+	{
+		samples.clear();
+		if (resampler.Push(points[i], times[i], samples))
+			sequences.emplace_back();
+		sequences.back().insert(sequences.back().end(), samples.begin(), samples.end());
+	}
+
+	return sequences;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+#include <armadillo>
+
+using namespace std;
+
+// Turns timestamped cursor events into fixed-rate samples by linear interpolation, so a step of the
+// models always spans the same wall-clock time. Sample times are the first event's time plus whole
+// periods; an input gap longer than max_gap (or a clock going backwards) starts a new sequence.
+class Resampler
+{
+public:
+	struct Config
+	{
+		chrono::microseconds period = 8ms;
+		chrono::microseconds max_gap = 40ms;
+	};
+
+private:
+	Config config;
+
+	bool started = false;
+	arma::vec2 last_point;
+	chrono::system_clock::time_point last_time, next_time;
+
+public:
+	Resampler();
+	explicit Resampler(Config config);
+
+	// appends the samples due up to the event's time; true when the event starts a new sequence,
+	// its point is then the sequence's first sample
+	bool Push(const arma::vec2& point, chrono::system_clock::time_point time, vector<arma::vec2>& samples);
+
+	void Reset() { started = false; }
+
+	// time of the last sample Push() appended, at most one period before the last event
+	chrono::system_clock::time_point GetLastSampleTime() const { return next_time - config.period; }
+
+	const Config& GetConfig() const { return config; }
+
+	// fixed-rate sequences of one recorded sequence, split at its gaps
+	static vector<vector<arma::vec2>> Resample(const vector<arma::vec2>& points,
+											   const vector<chrono::system_clock::time_point>& times,
+											   const Config& config);
+};
@@ -0,0 +1,245 @@
+#include "pch.h"
+
+#include "SequenceLogger.h"
+#include "Trace.h"
+
+using namespace chrono;
+
+static constexpr char magic[4] = {'M', 'L', 'S', 'Q'};
+static constexpr uint32_t version = 1;
+
+static void put_varint( vector<uint8_t>& out, uint64_t v )
+{
+	for (; v >= 0x80; v >>= 7)
+		out.push_back(uint8_t(v) | 0x80);
+	out.push_back(uint8_t(v));
+}
+
+static void put_zigzag( vector<uint8_t>& out, int64_t v )
+{
+	put_varint(out, (uint64_t(v) << 1) ^ uint64_t(v >> 63));
+}
+
+static bool get_varint( const uint8_t*& p, const uint8_t* end, uint64_t& v )
+{
+	v = 0;
+	for (int shift = 0; p < end && shift < 64; shift += 7)
+	{
+		uint8_t byte = *p++;
+		v |= uint64_t(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) return true;
+	}
+	return false;
+}
+
+static bool get_zigzag( const uint8_t*& p, const uint8_t* end, int64_t& v )
+{
+	uint64_t u;
+	if (!get_varint(p, end, u)) return false;
+	v = int64_t(u >> 1) ^ -int64_t(u & 1);
+	return true;
+}
+
+static void put_u32( vector<uint8_t>& out, uint32_t v )
+{
+	for (int i = 0; i < 4; ++i)
+		out.push_back(uint8_t(v >> (i * 8)));
+}
+
+static int64_t to_us( system_clock::time_point t )
+{
+	return duration_cast<microseconds>(t.time_since_epoch()).count();
+}
+
+SequenceLogger::SequenceLogger() : SequenceLogger(Config())
+{
+}
+
+SequenceLogger::SequenceLogger(Config config) : config(move(config))
+{
+	writer = thread([this] { WriterLoop(); });
+}
+
+SequenceLogger::~SequenceLogger()
+{
+	stopping = true;
+	wake.notify_one();
+	writer.join();
+}
+
+bool SequenceLogger::Log(const vector<arma::vec2>& points, const vector<system_clock::time_point>& times)
+{
+	TRACE_SCOPE("sequence_logger.log");
+
+	if (points.empty() || points.size() != times.size()) return false;
+
+	vector<uint8_t> record(4);
+	record.reserve(16 + points.size() * 4);
+
+	put_varint(record, points.size());
+	put_varint(record, to_us(times.front()));
+
+	int64_t x = 0, y = 0, t = to_us(times.front());
+	for (size_t i = 0; i < points.size(); ++i)
+	{
+		int64_t px = llround(points[i][0]), py = llround(points[i][1]), pt = to_us(times[i]);
+		put_zigzag(record, px - x);
+		put_zigzag(record, py - y);
+		put_zigzag(record, pt - t);
+		x = px, y = py, t = pt;
+	}
+
+	uint32_t payload_size = record.size() - 4;
+	for (int i = 0; i < 4; ++i)
+		record[i] = uint8_t(payload_size >> (i * 8));
+
+	size_t tail = queue_tail.load(memory_order_relaxed);
+	bool full = tail - queue_head.load(memory_order_acquire) == queue_capacity;
+
+	if (full || queued_bytes.load(memory_order_relaxed) + record.size() > config.memory_ceiling)
+	{
+		dropped_n.fetch_add(1, memory_order_relaxed);
+		return false;
+	}
+
+	queued_bytes.fetch_add(record.size(), memory_order_relaxed);
+	queue[tail % queue_capacity] = move(record);
+	queue_tail.store(tail + 1, memory_order_release);
+
+	wake.notify_one();
+	return true;
+}
+
+void SequenceLogger::WriterLoop()
+{
+	TRACE_THREAD("sequence_logger");
+
+	while (true)
+	{
+		bool stop = stopping.load(memory_order_acquire);
+
+		size_t head = queue_head.load(memory_order_relaxed);
+		size_t tail = queue_tail.load(memory_order_acquire);
+
+		for (; head != tail; ++head)
+		{
+			vector<uint8_t> record = move(queue[head % queue_capacity]);
+			queue_head.store(head + 1, memory_order_release);
+
+			WriteRecord(record);
+			queued_bytes.fetch_sub(record.size(), memory_order_relaxed);
+		}
+
+		if (file.is_open()) file.flush();
+		if (stop) break;
+
+		// producers notify without the lock, a missed wakeup only delays the write by the timeout
+		unique_lock lock(wake_mutex);
+		wake.wait_for(lock, 100ms);
+	}
+}
+
+void SequenceLogger::WriteRecord(const vector<uint8_t>& record)
+{
+	TRACE_SCOPE("sequence_logger.write");
+
+	bool rotate = file_bytes >= config.max_file_bytes || steady_clock::now() - file_opened >= config.max_file_age;
+	if (!file.is_open() || rotate) OpenFile();
+	if (!file) return;
+
+	file.write((const char*)record.data(), record.size());
+	file_bytes += record.size();
+	written_n.fetch_add(1, memory_order_relaxed);
+}
+
+void SequenceLogger::OpenFile()
+{
+	file.close();
+
+	error_code error;
+	filesystem::create_directories(config.directory, error);
+
+	// never replaces a log: another process, or a restart within the same second, may already own the name
+	int64_t start_s = duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
+	for (int attempt = 0; attempt < 10000 && !file.is_open(); ++attempt)
+	{
+		file.clear();
+		file.open(config.directory / format("sequences_{}_{:04}.mlsq", start_s, file_n++), ios::binary | ios::out | ios::noreplace);
+	}
+
+	vector<uint8_t> header(begin(magic), end(magic));
+	put_u32(header, version);
+	file.write((const char*)header.data(), header.size());
+
+	file_bytes = header.size();
+	file_opened = steady_clock::now();
+}
+
+vector<SequenceLogger::Sequence> SequenceLogger::Read(const filesystem::path& path)
+{
+	vector<filesystem::path> filenames;
+	if (filesystem::is_directory(path))
+	{
+		for (const filesystem::directory_entry& entry : filesystem::directory_iterator(path))
+			if (entry.is_regular_file() && entry.path().extension() == ".mlsq")
+				filenames.push_back(entry.path());
+		ranges::sort(filenames);
+	}
+	else
+		filenames.push_back(path);
+
+	vector<Sequence> sequences;
+
+	for (const filesystem::path& filename : filenames)
+	{
+		ifstream file(filename, ios::binary);
+		vector<uint8_t> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+		if (data.size() < 8 || !equal(begin(magic), end(magic), data.begin())) continue;
+
+		const uint8_t* p = data.data() + 8;
+		const uint8_t* data_end = data.data() + data.size();
+
+		while (data_end - p >= 4)
+		{
+			uint32_t payload_size = p[0] | p[1] << 8 | p[2] << 16 | uint32_t(p[3]) << 24;
+			p += 4;
+
+			// a record cut short by a crash ends the file
+			if (data_end - p < payload_size) break;
+			const uint8_t* record_end = p + payload_size;
+
+			uint64_t points_n, start_us;
+			if (!get_varint(p, record_end, points_n) || !get_varint(p, record_end, start_us)) break;
+
+			// a point takes at least three bytes, a larger count is corrupt and would be reserved as is
+			if (points_n > payload_size / 3)
+			{
+				p = record_end;
+				continue;
+			}
+
+			Sequence seq;
+			seq.points.reserve(points_n);
+			seq.times.reserve(points_n);
+
+			int64_t x = 0, y = 0, t = start_us;
+			for (uint64_t i = 0; i < points_n; ++i)
+			{
+				int64_t dx, dy, dt;
+				if (!get_zigzag(p, record_end, dx) || !get_zigzag(p, record_end, dy) || !get_zigzag(p, record_end, dt)) break;
+				x += dx, y += dy, t += dt;
+				seq.points.push_back({double(x), double(y)});
+				seq.times.push_back(system_clock::time_point(duration_cast<system_clock::duration>(microseconds(t))));
+			}
+
+			// partially decoded sequences are dropped
+			if (seq.points.size() == points_n)
+				sequences.push_back(move(seq));
+
+			p = record_end;
+		}
+	}
+
+	return sequences;
+}
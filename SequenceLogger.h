@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <armadillo>
+
+using namespace std;
+
+// Append-only log of cursor sequences for continuous data collection. Log() encodes a sequence and hands it
+// to a background writer through a lock-free single-producer queue, so the input thread never touches the disk.
+// Records that would push the queued bytes over the memory ceiling (or overflow the queue) are dropped and counted.
+//
+// File format: "MLSQ" magic, u32 version, then records of [u32 payload size][payload]. The payload is varints:
+// points count, start time in microseconds since the epoch, then per point zigzag deltas of x, y (whole pixels)
+// and of the timestamp in microseconds.
+class SequenceLogger
+{
+public:
+	struct Config
+	{
+		filesystem::path directory = "sequences";
+		uint64_t max_file_bytes = 16 << 20;
+		chrono::seconds max_file_age = 1h;
+		size_t memory_ceiling = 4 << 20;
+	};
+
+	struct Sequence
+	{
+		vector<arma::vec2> points;
+		vector<chrono::system_clock::time_point> times;
+	};
+
+private:
+	static constexpr size_t queue_capacity = 1024;
+
+	Config config;
+
+	array<vector<uint8_t>, queue_capacity> queue;
+	atomic<size_t> queue_head = 0, queue_tail = 0;
+	atomic<size_t> queued_bytes = 0;
+	atomic<uint64_t> dropped_n = 0, written_n = 0;
+
+	atomic<bool> stopping = false;
+	mutex wake_mutex;
+	condition_variable wake;
+	thread writer;
+
+	ofstream file;
+	uint64_t file_bytes = 0;
+	chrono::steady_clock::time_point file_opened;
+	int file_n = 0;
+
+	void WriterLoop();
+	void WriteRecord(const vector<uint8_t>& record);
+	void OpenFile();
+
+public:
+	SequenceLogger();
+	explicit SequenceLogger(Config config);
+	~SequenceLogger();
+
+	bool Log(const vector<arma::vec2>& points, const vector<chrono::system_clock::time_point>& times);
+
+	uint64_t GetDroppedCount() const { return dropped_n; }
+	uint64_t GetWrittenCount() const { return written_n; }
+
+	// reads one log file or every log file of a directory, in file name order
+	static vector<Sequence> Read(const filesystem::path& path);
+};
@@ -0,0 +1,231 @@
+#include "pch.h"
+
+#include "Trace.h"
+
+#include <atomic>
+#include <mutex>
+#include <bit>
+#include <map>
+#include <utility>
+
+using namespace std;
+using namespace chrono;
+
+namespace trace
+{
+	static constexpr int ring_capacity = 1 << 16;
+	static constexpr int max_stages = 64;
+
+	// log-linear latency buckets: 8 buckets per power of two of nanoseconds
+	static constexpr int sub_bits = 3;
+	static constexpr int sub_buckets = 1 << sub_bits;
+	static constexpr int buckets_n = 64 * sub_buckets;
+
+	struct Event
+	{
+		const char* name;
+		int64_t start, end;
+	};
+
+	// written only by the owning thread, read by the exporter
+	struct Histogram
+	{
+		atomic<const char*> name = nullptr;
+		atomic<uint64_t> count = 0, total_ns = 0, max_ns = 0;
+		atomic<uint64_t> buckets[buckets_n] = {};
+	};
+
+	struct ThreadBuffer
+	{
+		uint32_t tid = 0;
+		string name;
+		atomic<uint64_t> head = 0;
+		vector<Event> events = vector<Event>(ring_capacity);
+		Histogram stages[max_stages];
+	};
+
+	static mutex registry_mutex;
+	static vector<unique_ptr<ThreadBuffer>> registry;
+
+	// buffers outlive their threads, the exporter still reads events of finished training tasks
+	static ThreadBuffer& thread_buffer()
+	{
+		thread_local ThreadBuffer* buffer = []
+		{
+			lock_guard lock(registry_mutex);
+			unique_ptr<ThreadBuffer>& new_buffer = registry.emplace_back(make_unique<ThreadBuffer>());
+			new_buffer->tid = registry.size();
+			return new_buffer.get();
+		}();
+
+		return *buffer;
+	}
+
+	static void bump( atomic<uint64_t>& counter, uint64_t n )
+	{
+		counter.store(counter.load(memory_order_relaxed) + n, memory_order_relaxed);
+	}
+
+	static int bucket( uint64_t ns )
+	{
+		if (ns < sub_buckets) return int(ns);
+		int octave = bit_width(ns) - 1;
+		int sub = int(ns >> (octave - sub_bits)) & (sub_buckets - 1);
+		return min(octave * sub_buckets + sub, buckets_n - 1);
+	}
+
+	static double bucket_middle_ns( int b )
+	{
+		if (b < sub_buckets) return b;
+		int octave = b / sub_buckets, sub = b % sub_buckets;
+		return ldexp(sub_buckets + sub + 0.5, octave - sub_bits);
+	}
+
+	// stages are keyed by the name literal's address, open addressing inside the thread's table
+	static Histogram* find_stage( ThreadBuffer& buffer, const char* name )
+	{
+		size_t h = (uintptr_t(name) >> 3) % max_stages;
+		for (int i = 0; i < max_stages; ++i)
+		{
+			Histogram& stage = buffer.stages[(h + i) % max_stages];
+			const char* stage_name = stage.name.load(memory_order_relaxed);
+			if (stage_name == name) return &stage;
+			if (!stage_name)
+			{
+				stage.name.store(name, memory_order_release);
+				return &stage;
+			}
+		}
+
+		return nullptr;
+	}
+
+	int64_t now()
+	{
+		static const steady_clock::time_point origin = steady_clock::now();
+		return duration_cast<nanoseconds>(steady_clock::now() - origin).count();
+	}
+
+	void record( const char* name, int64_t start_ns, int64_t end_ns )
+	{
+		ThreadBuffer& buffer = thread_buffer();
+
+		uint64_t head = buffer.head.load(memory_order_relaxed);
+		buffer.events[head % ring_capacity] = {name, start_ns, end_ns};
+		buffer.head.store(head + 1, memory_order_release);
+
+		Histogram* stage = find_stage(buffer, name);
+		if (!stage) return;
+
+		uint64_t ns = max<int64_t>(end_ns - start_ns, 0);
+		bump(stage->count, 1);
+		bump(stage->total_ns, ns);
+		bump(stage->buckets[bucket(ns)], 1);
+		if (ns > stage->max_ns.load(memory_order_relaxed))
+			stage->max_ns.store(ns, memory_order_relaxed);
+	}
+
+	void set_thread_name( const char* name )
+	{
+		ThreadBuffer& buffer = thread_buffer();
+		lock_guard lock(registry_mutex);
+		buffer.name = name;
+	}
+
+	vector<StageStats> stage_stats()
+	{
+		struct Merged { uint64_t count = 0, total_ns = 0, max_ns = 0; array<uint64_t, buckets_n> buckets = {}; };
+		map<string, Merged> merged;
+
+		{
+			lock_guard lock(registry_mutex);
+			for (unique_ptr<ThreadBuffer>& buffer : registry)
+			for (Histogram& stage : buffer->stages)
+			{
+				const char* name = stage.name.load(memory_order_acquire);
+				if (!name) continue;
+
+				Merged& m = merged[name];
+				m.count += stage.count.load(memory_order_relaxed);
+				m.total_ns += stage.total_ns.load(memory_order_relaxed);
+				m.max_ns = max(m.max_ns, stage.max_ns.load(memory_order_relaxed));
+				for (int b = 0; b < buckets_n; ++b)
+					m.buckets[b] += stage.buckets[b].load(memory_order_relaxed);
+			}
+		}
+
+		vector<StageStats> stats;
+		for (auto& [name, m] : merged)
+		{
+			if (m.count == 0) continue;
+
+			auto percentile = [&](double p)
+			{
+				uint64_t rank = uint64_t(ceil(p * m.count)), seen = 0;
+				for (int b = 0; b < buckets_n; ++b)
+					if ((seen += m.buckets[b]) >= rank) return min(bucket_middle_ns(b), double(m.max_ns)) / 1000;
+				return m.max_ns / 1000.;
+			};
+
+			StageStats& s = stats.emplace_back();
+			s.name = name;
+			s.count = m.count;
+			s.total_us = m.total_ns / 1000.;
+			s.mean_us = s.total_us / m.count;
+			s.p50_us = percentile(0.5);
+			s.p90_us = percentile(0.9);
+			s.p99_us = percentile(0.99);
+			s.max_us = m.max_ns / 1000.;
+		}
+
+		return stats;
+	}
+
+	void write_chrome_trace( const filesystem::path& filename )
+	{
+		ofstream file(filename, ios::out | ios::trunc);
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+		bool first = true;
+		auto separator = [&] { return exchange(first, false) ? "" : ",\n"; };
+
+		lock_guard lock(registry_mutex);
+		for (unique_ptr<ThreadBuffer>& buffer : registry)
+		{
+			if (!buffer->name.empty())
+				file << separator() << format(R"({{"name":"thread_name","ph":"M","pid":1,"tid":{},"args":{{"name":"{}"}}}})",
+											  buffer->tid, buffer->name);
+
+			uint64_t head = buffer->head.load(memory_order_acquire);
+			for (uint64_t i = head > ring_capacity ? head - ring_capacity : 0; i < head; ++i)
+			{
+				const Event& e = buffer->events[i % ring_capacity];
+				file << separator() << format(R"({{"name":"{}","ph":"X","pid":1,"tid":{},"ts":{:.3f},"dur":{:.3f}}})",
+											  e.name, buffer->tid, e.start / 1000., (e.end - e.start) / 1000.);
+			}
+		}
+
+		file << "\n]}\n";
+	}
+
+	void write_stage_stats( const filesystem::path& filename )
+	{
+		ofstream file(filename, ios::out | ios::trunc);
+		file << "{\"stages\":[\n";
+
+		for (bool first = true; const StageStats& s : stage_stats())
+		{
+			file << (exchange(first, false) ? "" : ",\n");
+			file << format(R"({{"name":"{}","count":{},"total_us":{:.1f},"mean_us":{:.3f},"p50_us":{:.3f},"p90_us":{:.3f},"p99_us":{:.3f},"max_us":{:.3f}}})",
+						   s.name, s.count, s.total_us, s.mean_us, s.p50_us, s.p90_us, s.p99_us, s.max_us);
+		}
+
+		file << "\n]}\n";
+	}
+
+	void export_all( const filesystem::path& trace_filename, const filesystem::path& stats_filename )
+	{
+		write_chrome_trace(trace_filename);
+		write_stage_stats(stats_filename);
+	}
+}
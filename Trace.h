@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+// Scoped hot-path instrumentation. Every thread records into its own ring buffer and per-stage latency
+// histogram without locks; export_all() writes a Chrome trace-event file (chrome://tracing, Perfetto)
+// and a per-stage latency summary. The exporters read the rings unsynchronized, so call them once every
+// other recording thread has finished. Build with TRACING=0 to compile all macros out.
+
+#ifndef TRACING
+#define TRACING 1
+#endif
+
+namespace trace
+{
+	// steady clock nanoseconds since the first call
+	int64_t now();
+
+	void record( const char* name, int64_t start_ns, int64_t end_ns );
+	void set_thread_name( const char* name );
+
+	struct Scope
+	{
+		const char* name;
+		int64_t start;
+
+		Scope( const char* name ) : name(name), start(now()) {}
+		~Scope() { record(name, start, now()); }
+	};
+
+	struct StageStats
+	{
+		std::string name;
+		uint64_t count = 0;
+		double total_us = 0, mean_us = 0, p50_us = 0, p90_us = 0, p99_us = 0, max_us = 0;
+	};
+
+	std::vector<StageStats> stage_stats();
+
+	void write_chrome_trace( const std::filesystem::path& filename );
+	void write_stage_stats( const std::filesystem::path& filename );
+	void export_all( const std::filesystem::path& trace_filename, const std::filesystem::path& stats_filename );
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#if TRACING
+#define TRACE_SCOPE(name) trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_NOW() trace::now()
+#define TRACE_RECORD(name, start_ns) trace::record(name, start_ns, trace::now())
+#define TRACE_THREAD(name) trace::set_thread_name(name)
+#define TRACE_EXPORT(trace_filename, stats_filename) trace::export_all(trace_filename, stats_filename)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_NOW() int64_t(0)
+#define TRACE_RECORD(name, start_ns) ((void)(start_ns))
+#define TRACE_THREAD(name) ((void)0)
+#define TRACE_EXPORT(trace_filename, stats_filename) ((void)0)
+#endif
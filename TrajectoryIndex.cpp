@@ -0,0 +1,312 @@
+#include "pch.h"
+
+#include "TrajectoryIndex.h"
+#include "Converters.h"
+#include "Trace.h"
+
+using namespace arma;
+
+using Encoder = TConverter<Mode::AnglesLengths>;
+
+static constexpr int sample_points = TrajectoryIndex::window_points + TrajectoryIndex::continuation_points;
+
+TrajectoryIndex::TrajectoryIndex(int neighbours_n) : neighbours_n(neighbours_n)
+{
+}
+
+int TrajectoryIndex::NewNode()
+{
+	if (free_nodes.empty())
+	{
+		nodes.emplace_back();
+		return nodes.size() - 1;
+	}
+
+	int node = free_nodes.back();
+	free_nodes.pop_back();
+	return node;
+}
+
+// fills node with a balanced subtree over entries[begin, end), split at the median of the widest dimension
+void TrajectoryIndex::BuildNode(int node, vector<int>& entries, int begin, int end)
+{
+	int split = 0;
+	double widest = 0;
+
+	if (end - begin > leaf_size)
+	for (int d = 0; d < features_n; ++d)
+	{
+		auto [low, high] = ranges::minmax(ranges::subrange(entries.begin() + begin, entries.begin() + end)
+										  | views::transform([&](int entry) { return Features(entry)[d]; }));
+		if (high - low > widest) widest = high - low, split = d;
+	}
+
+	// small or all equal: a leaf
+	if (widest == 0)
+	{
+		nodes[node] = {.size = end - begin, .entries = {entries.begin() + begin, entries.begin() + end}};
+		return;
+	}
+
+	int middle = (begin + end) / 2;
+	nth_element(entries.begin() + begin, entries.begin() + middle, entries.begin() + end,
+				[&](int a, int b) { return Features(a)[split] < Features(b)[split]; });
+
+	int left = NewNode(), right = NewNode();
+	nodes[node] = {split, Features(entries[middle])[split], left, right, end - begin};
+
+	BuildNode(left, entries, begin, middle);
+	BuildNode(right, entries, middle, end);
+}
+
+void TrajectoryIndex::Rebuild()
+{
+	TRACE_SCOPE("index.rebuild");
+
+	vector<int> entries(GetSize());
+	iota(entries.begin(), entries.end(), 0);
+
+	nodes.assign(1, {});
+	free_nodes.clear();
+	BuildNode(0, entries, 0, entries.size());
+}
+
+// appends the entries under node and frees its descendants, node itself is reused for the rebuilt subtree
+void TrajectoryIndex::CollectNode(int node, vector<int>& entries)
+{
+	if (nodes[node].split < 0)
+	{
+		entries.insert(entries.end(), nodes[node].entries.begin(), nodes[node].entries.end());
+		return;
+	}
+
+	for (int child : {nodes[node].left, nodes[node].right})
+	{
+		CollectNode(child, entries);
+		nodes[child] = {};
+		free_nodes.push_back(child);
+	}
+}
+
+void TrajectoryIndex::Insert(int entry)
+{
+	if (nodes.empty()) nodes.emplace_back();
+
+	const double* f = Features(entry);
+
+	// every subtree on the path from the root gains the entry
+	vector<int> path = {0};
+	for (;;)
+	{
+		Node& node = nodes[path.back()];
+		node.size++;
+		if (node.split < 0) break;
+		path.push_back(f[node.split] < node.value ? node.left : node.right);
+	}
+
+	int leaf = path.back();
+	nodes[leaf].entries.push_back(entry);
+
+	if (nodes[leaf].entries.size() > 2 * leaf_size)
+	{
+		vector<int> entries = move(nodes[leaf].entries);
+		BuildNode(leaf, entries, 0, entries.size());
+	}
+
+	// a tree whose children never hold more than balance of their parent's entries is at most this deep
+	double max_depth = log(max(1., double(GetSize()) / leaf_size)) / log(1 / balance) + 1;
+	if (path.size() <= max_depth) return;
+
+	for (int i = int(path.size()) - 2; i >= 0; --i)
+	{
+		const Node& node = nodes[path[i]];
+		if (max(nodes[node.left].size, nodes[node.right].size) > balance * node.size)
+		{
+			TRACE_SCOPE("index.rebalance");
+
+			vector<int> entries;
+			CollectNode(path[i], entries);
+			BuildNode(path[i], entries, 0, entries.size());
+			return;
+		}
+	}
+}
+
+// nearest is a max-heap on squared distance holding at most neighbours_n entries; offsets and bound2 are
+// the per-dimension distances from the query to the node's cell and their squared sum (Arya and Mount)
+void TrajectoryIndex::Search(int node_i, const double* query, double* offsets, double bound2, vector<pair<double, int>>& nearest) const
+{
+	const Node& node = nodes[node_i];
+
+	if (node.split < 0)
+	{
+		for (int entry : node.entries)
+		{
+			const double* f = Features(entry);
+
+			double distance2 = 0;
+			for (int d = 0; d < features_n; ++d)
+				distance2 += (query[d] - f[d]) * (query[d] - f[d]);
+
+			if (nearest.size() < neighbours_n)
+			{
+				nearest.push_back({distance2, entry});
+				ranges::push_heap(nearest);
+			}
+			else if (distance2 < nearest.front().first)
+			{
+				ranges::pop_heap(nearest);
+				nearest.back() = {distance2, entry};
+				ranges::push_heap(nearest);
+			}
+		}
+		return;
+	}
+
+	double offset = query[node.split] - node.value;
+	Search(offset < 0 ? node.left : node.right, query, offsets, bound2, nearest);
+
+	double old_offset = offsets[node.split];
+	double far_bound2 = bound2 - old_offset * old_offset + offset * offset;
+
+	if (nearest.size() < neighbours_n || far_bound2 < nearest.front().first)
+	{
+		offsets[node.split] = offset;
+		Search(offset < 0 ? node.right : node.left, query, offsets, far_bound2, nearest);
+		offsets[node.split] = old_offset;
+	}
+}
+
+vector<pair<double, int>> TrajectoryIndex::Nearest(const double* query) const
+{
+	vector<pair<double, int>> nearest;
+	if (GetSize() == 0) return nearest;
+
+	nearest.reserve(neighbours_n);
+	vector<double> offsets(features_n);
+	Search(0, query, offsets.data(), 0, nearest);
+
+	ranges::sort_heap(nearest);
+	return nearest;
+}
+
+void TrajectoryIndex::Build(const vector<vector<vec2>>& sequences)
+{
+	TRACE_SCOPE("index.build");
+
+	int samples_n = ranges::fold_left(sequences, 0,
+		[](int n, const vector<vec2>& seq) { return n + max(0, int(seq.size()) - sample_points + 1); });
+
+	features.resize(size_t(samples_n) * features_n);
+	continuations.resize(size_t(samples_n) * continuation_features_n);
+
+	PointsSoA samples(samples_n, sample_points);
+
+	for (int sample_i = 0; const vector<vec2>& seq : sequences)
+	for (int i = 0; i + sample_points <= int(seq.size()); ++i, ++sample_i)
+	for (int t = 0; t < sample_points; ++t)
+		samples.set(t, sample_i, seq[i + t]);
+
+	// aliases of the entry storage, one column per entry
+	mat input(features.data(), features_n, samples_n, false, true);
+	mat output(continuations.data(), continuation_features_n, samples_n, false, true);
+
+	BatchConverter<Mode::AnglesLengths> pipe(samples, 0);
+	pipe.in(input);
+	pipe.in(output);
+
+	Rebuild();
+}
+
+void TrajectoryIndex::Add(const vector<vec2>& sequence)
+{
+	TRACE_SCOPE("index.add");
+
+	for (int i = 0; i + sample_points <= int(sequence.size()); ++i)
+	{
+		int entry = GetSize();
+		features.resize(features.size() + features_n);
+		continuations.resize(continuations.size() + continuation_features_n);
+
+		mat input(features.data() + size_t(entry) * features_n, features_n, 1, false, true);
+		mat output(continuations.data() + size_t(entry) * continuation_features_n, continuation_features_n, 1, false, true);
+
+		Encoder pipe([it = sequence.begin() + i]() mutable { return *(it++); });
+		pipe.in(input.col(0));
+		pipe.in(output.col(0));
+
+		Insert(entry);
+	}
+}
+
+vector<vec2> TrajectoryIndex::Predict(int points_n, const function<vec2()>& feeder) const
+{
+	TRACE_SCOPE("index.predict");
+
+	// Build() without a complete window, or Read() of an empty index, leaves an empty root leaf
+	if (GetSize() == 0) return {};
+
+	vector<vec2> points;
+	points.reserve(window_points + points_n + continuation_points);
+
+	for (int i = 0; i < window_points; i++)
+		points.push_back(feeder());
+
+	vec query(features_n), offsets(features_n);
+	vector<pair<double, int>> nearest;
+	nearest.reserve(neighbours_n);
+
+	// longer horizons continue from the last window_points points, as the network's rollout does
+	while (points.size() < window_points + points_n)
+	{
+		Encoder pipe([it = points.end() - window_points]() mutable { return *(it++); });
+		pipe.in(query.col(0));
+
+		nearest.clear();
+		offsets.zeros();
+		{ TRACE_SCOPE("index.search"); Search(0, query.memptr(), offsets.memptr(), 0, nearest); }
+
+		int blend_n = min<int>(continuation_points, window_points + points_n - points.size());
+		vec blended(blend_n * 2, fill::zeros);
+		double weights = 0;
+
+		// inverse distance weights, an exact match dominates without dividing by zero
+		for (auto [distance2, entry] : nearest)
+		{
+			double w = 1 / (sqrt(distance2) + 1e-6);
+			const double* continuation = Continuation(entry);
+			for (int i = 0; i < blended.n_elem; ++i)
+				blended[i] += w * continuation[i];
+			weights += w;
+		}
+
+		pipe.out(vec(blended / weights), back_insert_iterator(points));
+	}
+
+	points.erase(points.begin(), points.begin() + window_points);
+	return points;
+}
+
+void TrajectoryIndex::Write(ostream& stream) const
+{
+	int entries_n = GetSize();
+	mat(features.data(), features_n, entries_n).save(stream);
+	mat(continuations.data(), continuation_features_n, entries_n).save(stream);
+}
+
+void TrajectoryIndex::Read(istream& stream)
+{
+	mat loaded_features, loaded_continuations;
+	loaded_features.load(stream);
+	loaded_continuations.load(stream);
+
+	if (loaded_features.n_rows != features_n || loaded_continuations.n_rows != continuation_features_n ||
+		loaded_features.n_cols != loaded_continuations.n_cols)
+		return;
+
+	features.assign(loaded_features.begin(), loaded_features.end());
+	continuations.assign(loaded_continuations.begin(), loaded_continuations.end());
+
+	// the tree is not stored, it is rebuilt balanced
+	Rebuild();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <mlpack.hpp>
+
+using namespace std;
+
+// Non-parametric predictor: a k-d tree over the AnglesLengths encodings of recorded windows. A query
+// encodes the last window_points points, finds the k nearest recorded windows and decodes the
+// inverse-distance blend of their encoded continuations after the query's last two points.
+// Because the encoding is relative, the recorded continuations apply at any position and heading.
+// Leaves hold up to 2 * leaf_size windows and a leaf that fills up is split at its median. Local splits
+// alone do not bound the depth under skewed live insertion, so an insertion that lands deeper than a
+// tree of the given balance can reach rebuilds the deepest unbalanced subtree on its path (scapegoat).
+class TrajectoryIndex
+{
+public:
+	static constexpr int window_points = 12;
+	static constexpr int continuation_points = 10;
+	static constexpr int features_n = (window_points - 2) * 2;
+	static constexpr int continuation_features_n = continuation_points * 2;
+
+	static constexpr int leaf_size = 32;
+
+	// largest share of a subtree's entries that one of its children may hold
+	static constexpr double balance = 0.7;
+
+private:
+	struct Node
+	{
+		int split = -1;		// feature dimension, -1 for leaves
+		double value = 0;	// left below value, right at or above it
+		int left = -1, right = -1;
+		int size = 0;		// entries in the subtree
+		vector<int> entries;
+	};
+
+	int neighbours_n;
+
+	// one entry per recorded window, features_n and continuation_features_n values each
+	vector<double> features, continuations;
+
+	vector<Node> nodes;
+	vector<int> free_nodes;
+
+	const double* Features(int entry) const { return features.data() + size_t(entry) * features_n; }
+	const double* Continuation(int entry) const { return continuations.data() + size_t(entry) * continuation_features_n; }
+
+	int NewNode();
+	void BuildNode(int node, vector<int>& entries, int begin, int end);
+	void CollectNode(int node, vector<int>& entries);
+	void Rebuild();
+	void Insert(int entry);
+	void Search(int node, const double* query, double* offsets, double bound2, vector<pair<double, int>>& nearest) const;
+
+public:
+	TrajectoryIndex(int neighbours_n = 8);
+
+	// replaces the index with every window of the sequences that has a full continuation
+	void Build(const vector<vector<arma::vec2>>& sequences);
+
+	// incremental insertion of every window of a live sequence
+	void Add(const vector<arma::vec2>& sequence);
+
+	// same contract as PathProjectionNN::Predict: reads window_points points, returns the points_n that follow;
+	// nothing while the index is empty
+	vector<arma::vec2> Predict(int points_n, const function<arma::vec2()>& feeder) const;
+
+	// the neighbours_n entries nearest to features_n encoded values, as (squared distance, entry), nearest first
+	vector<pair<double, int>> Nearest(const double* query) const;
+
+	const double* GetFeatures(int entry) const { return Features(entry); }
+
+	size_t GetSize() const { return features.size() / features_n; }
+
+	void Write(ostream& stream) const;
+	void Read(istream& stream);
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <cstdint>
+#include <numbers>
+
+// Branch-free polynomial approximations used by the batch converters.
+// Every function is written as straight-line arithmetic with selects instead of branches,
+// so loops over SoA lanes auto-vectorize (SSE2/AVX on x64, NEON on arm64).
+
+namespace fast
+{
+	// Maximum errors over the whole input domain (rsqrt's relative), each checked by validate_batch_converters().
+	inline constexpr double atan2_max_error = 1e-8;
+	inline constexpr double sincos_max_error = 1e-15;
+	inline constexpr double rsqrt_max_rel_error = 1e-15;
+
+	inline double select( bool c, double a, double b ) { return c ? a : b; }
+
+	// minimax odd polynomial for atan on [-1, 1]
+	inline double atan_unit( double x )
+	{
+		double x2 = x * x;
+		double p = 2.45676387390479956e-03;
+		p = p * x2 - 1.44015260032471375e-02;
+		p = p * x2 + 3.97815199598188812e-02;
+		p = p * x2 - 7.23488513624926404e-02;
+		p = p * x2 + 1.04989609210036454e-01;
+		p = p * x2 - 1.41612337075333242e-01;
+		p = p * x2 + 1.99859074974523583e-01;
+		p = p * x2 - 3.33325970817826508e-01;
+		p = p * x2 + 9.99999886394748488e-01;
+		return p * x;
+	}
+
+	inline double atan2( double y, double x )
+	{
+		double ax = std::abs(x), ay = std::abs(y);
+		double mx = std::max(ax, ay), mn = std::min(ax, ay);
+		double a = atan_unit(mn / std::max(mx, std::numeric_limits<double>::min()));
+
+		// octant fix-ups as sign and offset selects, so that no arm has to be computed conditionally
+		bool steep = ay > ax, back = x < 0;
+		a = select(steep, std::numbers::pi / 2, 0.) + select(steep, -1., 1.) * a;
+		a = select(back, std::numbers::pi, 0.) + select(back, -1., 1.) * a;
+		return std::copysign(a, y);
+	}
+
+	// sin and cos on [-pi/4, pi/4] after reduction by quadrant
+	inline void sincos( double a, double& s, double& c )
+	{
+		double q = a * (2 / std::numbers::pi);
+		q += std::copysign(0.5, q);
+		int32_t qi = int32_t(q);
+		double qd = double(qi);
+
+		// Cody-Waite reduction with pi/2 split in two parts
+		double r = a - qd * 1.57079632673412561417e+00;
+		r = r - qd * 6.07710050650619224932e-11;
+		double r2 = r * r;
+
+		double ps = 1.58969099521155010221e-10;
+		ps = ps * r2 - 2.50507602534068634195e-08;
+		ps = ps * r2 + 2.75573137070700676789e-06;
+		ps = ps * r2 - 1.98412698298579493134e-04;
+		ps = ps * r2 + 8.33333333332248946124e-03;
+		ps = ps * r2 - 1.66666666666666324348e-01;
+		ps = r + r * r2 * ps;
+
+		double pc = -1.13596475577881948265e-11;
+		pc = pc * r2 + 2.08757232129817482790e-09;
+		pc = pc * r2 - 2.75573143513906633035e-07;
+		pc = pc * r2 + 2.48015872894767294178e-05;
+		pc = pc * r2 - 1.38888888888741095749e-03;
+		pc = pc * r2 + 4.16666666666666019037e-02;
+		pc = 1 - 0.5 * r2 + r2 * r2 * pc;
+
+		int32_t quadrant = qi & 3;
+		bool swap = quadrant & 1;
+		s = select(swap, pc, ps) * select(quadrant >= 2, -1., 1.);
+		c = select(swap, ps, pc) * select((quadrant == 1) | (quadrant == 2), -1., 1.);
+	}
+
+	inline double rsqrt( double x )
+	{
+		double y = std::bit_cast<double>(0x5FE6EB50C7B537A9ll - (std::bit_cast<int64_t>(x) >> 1));
+		double hx = 0.5 * x;
+		y = y * (1.5 - hx * y * y);
+		y = y * (1.5 - hx * y * y);
+		y = y * (1.5 - hx * y * y);
+		y = y * (1.5 - hx * y * y);
+		return y;
+	}
+}
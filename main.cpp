@@ -4,6 +4,11 @@
 
 #define AGG_BGR24
 #include "PathProjectionNN.h"
+#include "Benchmarks.h"
+#include "Trace.h"
+#include "SequenceLogger.h"
+#include "TrajectoryIndex.h"
+#include "Resampler.h"
 #include "agg/examples/pixel_formats.h"
 #include "utils.h"
 
@@ -16,28 +21,60 @@ using namespace mlpack::ann;
 
 constexpr size_t operator ""_sz ( unsigned long long n ){ return n; }
 
-constexpr int prediction_size = 10;
+constexpr milliseconds prediction_horizon = 80ms;
+constexpr milliseconds sample_period = 8ms;
+constexpr milliseconds sequence_max_gap = 40ms;
 constexpr double out_coords_scale = 1;
 constexpr int training_data_size = 5000;
 constexpr bool load_training_data = false;
 constexpr bool save_training_data = false;
+constexpr bool run_benchmarks = false;
+constexpr bool log_sequences = false;
+constexpr bool export_header = false;
+constexpr bool use_trajectory_index = false;
+constexpr size_t trajectory_index_min_windows = 1000;
+constexpr PathProjectionNN::Model nn_model = PathProjectionNN::Model::FeedForward;
+constexpr int mouse_player_id = 0;
 
 constexpr int window_width = 1024;
 constexpr int window_height = 768;
 
 filesystem::path nn_params_filename = "nn_params";
 filesystem::path training_data_filename = "training_data.txt";
+filesystem::path sequences_directory = "sequences";
+filesystem::path exported_header_filename = "path_projection_model.h";
+filesystem::path trajectory_index_filename = "trajectory_index";
+filesystem::path trace_filename = "trace.json";
+filesystem::path trace_stats_filename = "trace_stats.json";
 
 the_application::the_application( pix_format_e format )
-	: platform_support(format, false), nn(new PathProjectionNN), pf(rbuf_window()), font_cache(font_engine)
+	: platform_support(format, false), nn(new PathProjectionNN(nn_model)),
+	  resampler(new Resampler({.period = sample_period, .max_gap = sequence_max_gap})),
+	  pf(rbuf_window()), font_cache(font_engine)
 {
+	nn->SetSamplePeriod(sample_period);
+
 	ifstream nn_params_file(nn_params_filename, ios::binary);
-	if (nn_params_file.is_open())
+	// parameters of the other model, or a damaged file, are ignored and the model is trained anew
+	if (nn_params_file.is_open() && nn->ReadNN(nn_params_file))
 	{
-		nn->ReadNN(nn_params_file);
 		trained = true;
+
+		if (export_header) write_exported_header();
 	}
 
+	if (use_trajectory_index)
+	{
+		trajectory_index = make_unique<TrajectoryIndex>();
+
+		ifstream index_file(trajectory_index_filename, ios::binary);
+		if (index_file.is_open())
+			trajectory_index->Read(index_file);
+	}
+
+	if (log_sequences)
+		sequence_logger = make_unique<SequenceLogger>(SequenceLogger::Config{.directory = sequences_directory});
+
 	if (load_training_data)
 	{
 		load_data();
@@ -45,6 +82,12 @@ the_application::the_application( pix_format_e format )
 	}
 }
 
+the_application::~the_application()
+{
+	// the training task uses the members and records trace events until it returns
+	if (training.valid()) training.wait();
+}
+
 void the_application::on_init()
 {
 	font_engine.load_font("roboto_medium.ttf", 0, glyph_ren_agg_gray8);
@@ -57,8 +100,11 @@ void the_application::on_init()
 
 void the_application::on_draw()
 {
+	TRACE_SCOPE("on_draw");
+
 	rasterizer_scanline_aa<> ras;
 	
+	int64_t rasterization_start = TRACE_NOW();
 	render_base->clear(rgba(1, 1, 1));
 
 	simple_path line(mouse);
@@ -78,13 +124,15 @@ void the_application::on_draw()
 
 	if (!prediction.empty())
 	{
-		simple_path prediction_line({mouse.back()});
+		simple_path prediction_line({samples.back()});
 		prediction_line.points.insert(prediction_line.points.end(), prediction.begin(), prediction.end());
 		stroke_path.attach(prediction_line);
 		ras.add_path(stroke_path);
 		render_scanlines_aa_solid(ras, sl, *render_base, rgba8(0, 0xff, 0, 0xff));
 	}
 
+	TRACE_RECORD("on_draw.rasterization", rasterization_start);
+
 	/*if (!prediction_errors.empty())
 	{
 		dotted_line err_lines(prediction_errors);
@@ -123,6 +171,8 @@ void the_application::on_draw()
 
 void the_application::draw_text( string_view str, double x, double y, rgba8 color )
 {
+	TRACE_SCOPE("draw_text");
+
 	double initial_x = x;
 
 	for (char ch : str)
@@ -148,30 +198,34 @@ void the_application::draw_text( string_view str, double x, double y, rgba8 colo
 
 void the_application::on_mouse_move( int x, int y, unsigned flags )
 {
+	TRACE_SCOPE("on_mouse_move");
+
 	auto now = system_clock::now();
 
-	if (!mouse_times.empty() && now - mouse_times.back() < 6ms) return;
 	if (!mouse.empty() && mouse.back()[0] == x && mouse.back()[1] == y) return;
 
 	auto flush_sequence = [&]
 	{
-		if (mouse.size() >= nn->GetInputSize() && !trained)
-			training_data.emplace_back(mouse.begin(), mouse.end());
+		if (samples.size() >= nn->GetInputSize() && !trained)
+			training_data.push_back(samples);
 
+		if (mouse.size() >= nn->GetInputSize() && sequence_logger)
+			sequence_logger->Log(mouse, mouse_times);
+
+		if (trained && trajectory_index)
+			trajectory_index->Add(samples);
+
+		nn->ResetPlayer(mouse_player_id);
 		mouse.clear(), mouse_times.clear();
+		samples.clear();
 		prediction.clear();
 		prediction_errors.clear();
 	};
 
-	if (mouse.size() >= 3)
-	{
-		auto it = mouse_times.rbegin();
-		duration common_rate1 = *(it) - *(it + 1);
-		duration common_rate2 = *(it + 1) - *(it + 2);
-		duration common_rate = min(common_rate1, common_rate2);
-		if (now - mouse_times.back() > common_rate * 1.8) 
-			flush_sequence();
-	}
+	// the models see fixed-rate samples, an input gap longer than sequence_max_gap ends the sequence
+	vector<vec2> new_samples;
+	if (resampler->Push({double(x), double(y)}, now, new_samples))
+		flush_sequence();
 
 	if (mouse.size() >= 4)
 	{
@@ -186,31 +240,44 @@ void the_application::on_mouse_move( int x, int y, unsigned flags )
 	mouse.push_back({double(x), double(y)});
 	mouse_times.push_back(now);
 
-	if (!trained)
+	for (const vec2& sample : new_samples)
 	{
-		if (mouse.size() > nn->GetInputSize())
-			++collected_data_size;
+		samples.push_back(sample);
 
-		if (collected_data_size == training_data_size)
+		if (!trained)
 		{
-			flush_sequence();
-			if (save_training_data) save_data();
-			train();
+			if (samples.size() > nn->GetInputSize())
+				++collected_data_size;
+
+			// every training_data_size samples, unless a run is still going: a run without a single sequence
+			// long enough for the model trains nothing and leaves collection on
+			bool training_idle = !training.valid() || training.wait_for(0s) == future_status::ready;
+			if (collected_data_size % training_data_size == 0 && training_idle)
+			{
+				flush_sequence();
+				if (save_training_data) save_data();
+				train();
+			}
 		}
-	}
-	else
-	{
-		if (!prediction.empty())
+		else
 		{
-			double err = length(mouse.back() - prediction[0]);
-			prediction_errors.push_back(err);
-			prediction_error = ranges::fold_right(prediction_errors, 0, plus()) / prediction_errors.size();
-			if (prediction_errors.size() > 100) prediction_errors.erase(prediction_errors.begin());
+			// each new sample is compared with the point predicted for its time
+			if (!prediction.empty())
+			{
+				double err = length(sample - prediction[0]);
+				prediction_errors.push_back(err);
+				prediction_error = ranges::fold_right(prediction_errors, 0, plus()) / prediction_errors.size();
+				if (prediction_errors.size() > 100) prediction_errors.erase(prediction_errors.begin());
+				prediction.erase(prediction.begin());
+			}
+
+			nn->Observe(mouse_player_id, sample);
 		}
-
-		prediction = predict();
 	}
 
+	if (trained && !new_samples.empty())
+		prediction = predict(now);
+
 	force_redraw();
 }
 
@@ -221,8 +288,11 @@ void the_application::on_idle()
 
 void the_application::train()
 {
-	training = async([&]
+	// the UI thread keeps appending to training_data until trained is set
+	training = async([&, sequences = training_data]
 	{
+		TRACE_THREAD("training");
+
 		auto epoch_callback = [&](int epoch, double loss)
 		{
 			ranges::move_backward(epoch_losses, epoch_losses + size(epoch_losses) - 1,  epoch_losses + size(epoch_losses));
@@ -231,22 +301,70 @@ void the_application::train()
 			force_redraw(); // thread-safe on windows
 		};
 
-		training_set_error = nn->Train(training_data, epoch_callback, {});
-		trained = true;
+		optional<double> error = nn->Train(sequences, epoch_callback, {});
+		if (!error)
+		{
+			force_redraw();
+			return;
+		}
+
+		training_set_error = *error;
+
+		if (trajectory_index)
+		{
+			trajectory_index->Build(sequences);
+
+			ofstream index_file(trajectory_index_filename, ios::binary);
+			trajectory_index->Write(index_file);
+		}
 
 		ofstream file(nn_params_filename, ios::binary);
 		nn->WriteNN(file);
 
+		if (export_header) write_exported_header();
+
+		// the UI thread predicts once trained is set, the network is not used here after that
+		trained = true;
+
 		force_redraw();
 	});
 }
 
-vector<vec2> the_application::predict()
+// exports into a temporary file renamed over the header only on success, so a failed export (the recurrent
+// model has no standalone form) never leaves an empty or partial header behind
+void the_application::write_exported_header()
 {
-	if (mouse.size() <= nn->GetInputSize()) return {};
-	auto feeder = [it = (mouse.rbegin() + nn->GetInputSize()).base()]() mutable { return *(it++); };
-	vector<vec2> predictions = nn->Predict(prediction_size, feeder);
-	return predictions;
+	filesystem::path temporary = exported_header_filename;
+	temporary += ".tmp";
+
+	bool exported;
+	{
+		ofstream header_file(temporary, ios::out | ios::trunc);
+		exported = nn->ExportHeader(header_file) && header_file.flush();
+	}
+
+	error_code error;
+	if (exported)
+		filesystem::rename(temporary, exported_header_filename, error);
+	else
+		filesystem::remove(temporary, error);
+}
+
+vector<vec2> the_application::predict( system_clock::time_point now )
+{
+	if (samples.size() <= nn->GetInputSize()) return {};
+
+	// the rollout starts at the last sample, the horizon is counted from the current event
+	auto since_last_sample = duration_cast<microseconds>(now - resampler->GetLastSampleTime());
+
+	// the index replaces the network once it holds enough windows, a few live sequences do not
+	if (trajectory_index && trajectory_index->GetSize() >= trajectory_index_min_windows)
+	{
+		auto feeder = [it = samples.end() - TrajectoryIndex::window_points]() mutable { return *(it++); };
+		return trajectory_index->Predict(nn->GetHorizonPoints(prediction_horizon, since_last_sample), feeder);
+	}
+
+	return nn->PredictPlayer(mouse_player_id, prediction_horizon, since_last_sample);
 }
 
 vec2 the_application::interpl_predict()
@@ -282,7 +400,7 @@ void the_application::save_data()
 	{
 		string seq_txt;
 		for (vec2& pt : seq)
-			seq_txt += std::format("({},{}) ", (int)pt[0], (int)pt[1]);
+			seq_txt += std::format("({},{}) ", pt[0], pt[1]);
 		file << seq_txt << '\n';
 	}
 }
@@ -291,7 +409,8 @@ void the_application::load_data()
 {
 	ifstream file(training_data_filename);
 	string line;
-	regex vec_coords("\\(([0-9]+),([0-9]+)\\)");
+	// the shortest round-trip form of std::format, older files hold plain integers
+	regex vec_coords("\\((-?[0-9.]+(?:e[-+]?[0-9]+)?),(-?[0-9.]+(?:e[-+]?[0-9]+)?)\\)");
 
 	while (getline(file, line))
 	{
@@ -312,8 +431,19 @@ void the_application::load_data()
 
 int agg_main( int argc, char* argv[] )
 {
-	the_application app(pix_format);
-	app.caption("ml for fun");
-	app.init(window_width, window_height, 0);
-	return app.run();
+	if (run_benchmarks) return benchmark_main(argc, argv);
+
+	TRACE_THREAD("main");
+
+	int result;
+	{
+		the_application app(pix_format);
+		app.caption("ml for fun");
+		app.init(window_width, window_height, 0);
+		result = app.run();
+	}
+
+	// the application is destroyed: the training task and the logger thread have stopped recording
+	TRACE_EXPORT(trace_filename, trace_stats_filename);
+	return result;
 }
\ No newline at end of file
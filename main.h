@@ -9,15 +9,22 @@ using namespace mlpack;
 class the_application : public platform_support
 {
 	unique_ptr<class PathProjectionNN> nn;
+	unique_ptr<class SequenceLogger> sequence_logger;
+	unique_ptr<class TrajectoryIndex> trajectory_index;
+	unique_ptr<class Resampler> resampler;
 
 	vector<double> losses;
 
-	bool trained = false;
+	// set by the training task once it is done with the network
+	atomic<bool> trained = false;
 	int collected_data_size = 0;
 	double training_set_error = 0;
 
 	vector<vec2> mouse, prediction;
 
+	// mouse resampled at the fixed rate the models see
+	vector<vec2> samples;
+
 	vector<double> prediction_errors;
 	double prediction_error = 0;
 
@@ -41,6 +48,7 @@ class the_application : public platform_support
 
 public:
 	the_application( pix_format_e format );
+	~the_application();
 	void on_init() override;
 	void on_draw() override;
 	void on_mouse_move( int x, int y, unsigned flags ) override;
@@ -49,7 +57,8 @@ public:
 	void draw_text( string_view str, double x, double y, rgba8 color = {0, 0, 0, 0xff} );
 	
 	void train();
-	vector<vec2> predict();
+	vector<vec2> predict( system_clock::time_point now );
+	void write_exported_header();
 	vec2 interpl_predict();
 	void save_data();
 	void load_data();
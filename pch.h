@@ -20,5 +20,6 @@
 #include <regex>
 #include <numbers>
 #include <future>
+#include <atomic>
 #include <format>
 #include <filesystem>
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include <agg_basics.h>
 #include <armadillo>
 
+#include "vec2_math.h"
+
 using namespace std;
 using namespace agg;
 using namespace arma;
@@ -52,35 +54,3 @@ struct dotted_line
 		}
 	}
 };
-
-inline double length( const vec2& v ) { return sqrt(dot(v, v)); }
-
-inline double cross( const vec2& v1, const vec2& v2 )
-{
-	return v1[1] * v2[0] - v1[0] * v2[1];
-}
-
-template< typename type = double >
-vec2 normalized( const vec2& v, type&& len = double() )
-{
-	len = length(v);
-	double k = 1. / len;
-	return {v[0] * k, v[1] * k};
-}
-
-inline double angle( const vec2& v1, const vec2& v2 )
-{
-	double d = dot(v1, v2);
-	double c = cross(v1, v2);
-	return atan2(c, d);
-}
-
-inline vec2 rotate( const vec2& v, const vec2& rot )
-{
-	return {v[0] * rot[0] - v[1] * rot[1], v[1] * rot[0] + v[0] * rot[1]};
-}
-
-inline bool equal( const vec2& v1, const vec2& v2 )
-{
-	return v1[0] == v2[0] && v1[1] == v2[1];
-}
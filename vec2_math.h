@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cmath>
+#include <armadillo>
+
+using namespace std;
+using namespace arma;
+
+// 2d vector helpers shared by the application and the converters
+
+inline double length( const vec2& v ) { return sqrt(dot(v, v)); }
+
+inline double cross( const vec2& v1, const vec2& v2 )
+{
+	return v1[1] * v2[0] - v1[0] * v2[1];
+}
+
+template< typename type = double >
+vec2 normalized( const vec2& v, type&& len = double() )
+{
+	len = length(v);
+	double k = 1. / len;
+	return {v[0] * k, v[1] * k};
+}
+
+inline double angle( const vec2& v1, const vec2& v2 )
+{
+	double d = dot(v1, v2);
+	double c = cross(v1, v2);
+	return atan2(c, d);
+}
+
+inline vec2 rotate( const vec2& v, const vec2& rot )
+{
+	return {v[0] * rot[0] - v[1] * rot[1], v[1] * rot[0] + v[0] * rot[1]};
+}
+
+inline bool equal( const vec2& v1, const vec2& v2 )
+{
+	return v1[0] == v2[0] && v1[1] == v2[1];
+}